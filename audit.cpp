@@ -1,3 +1,4 @@
+#include <QSaveFile>
 #include "quazip.h"
 #include "quazipfile.h"
 #include "7zCrc.h"
@@ -14,10 +15,115 @@
 #include "mainwindow.h"
 #include "mameopt.h"
 
+// reads the directory of one archive in a pool thread
+class AuditArchiveTask : public QRunnable
+{
+public:
+	AuditArchiveTask(AuditArchive *_archive, QAtomicInt *_numDone) :
+		archive(_archive),
+		numDone(_numDone)
+	{
+	}
+
+	void run()
+	{
+		if (archive->is7z)
+			read7z();
+		else
+			readZip();
+
+		numDone->fetchAndAddRelaxed(1);
+	}
+
+private:
+	AuditArchive *archive;
+	QAtomicInt *numDone;
+
+	void readZip()
+	{
+		//open zip file
+		QuaZip zip(archive->path);
+		if(!zip.open(QuaZip::mdUnzip))
+			return;
+
+		QuaZipFileInfo zipFileInfo;
+
+		//iterate all files in the zip
+		for(bool more=zip.goToFirstFile(); more; more=zip.goToNextFile())
+		{
+			if(!zip.getCurrentFileInfo(&zipFileInfo))
+				continue;
+
+			archive->crcs << zipFileInfo.crc;
+		}
+	}
+
+	// CrcGenerateTable() must be called before
+	void read7z()
+	{
+		CFileInStream archiveStream;
+		CLookToRead lookStream;
+		CSzArEx db;
+		SRes res;
+		ISzAlloc allocImp;
+		ISzAlloc allocTempImp;
+
+		if (InFile_Open(&archiveStream.file, qPrintable(archive->path)))
+			return;
+
+		FileInStream_CreateVTable(&archiveStream);
+		LookToRead_CreateVTable(&lookStream, False);
+
+		lookStream.realStream = &archiveStream.s;
+		LookToRead_Init(&lookStream);
+
+		allocImp.Alloc = SzAlloc;
+		allocImp.Free = SzFree;
+
+		allocTempImp.Alloc = SzAllocTemp;
+		allocTempImp.Free = SzFreeTemp;
+
+		SzArEx_Init(&db);
+		res = SzArEx_Open(&db, &lookStream.s, &allocImp, &allocTempImp);
+
+		if (res == SZ_OK)
+		{
+			for (UInt32 i = 0; i < db.db.NumFiles; i++)
+				archive->crcs << db.db.Files[i].FileCRC;
+		}
+		SzArEx_Free(&db, &allocImp);
+		File_Close(&archiveStream.file);
+	}
+};
+
+AuditResult::AuditResult() :
+	dat(pMameDat),
+	hasDisks(false)
+{
+}
+
+bool AuditResult::isRomAvailable(RomInfo *romInfo) const
+{
+	return romInfo->status == "nodump" || availableRoms.contains(romInfo);
+}
+
+// disks that are not staged keep their current state
+bool AuditResult::isDiskAvailable(DiskInfo *diskInfo) const
+{
+	if (!hasDisks)
+		return diskInfo->available;
+
+	return diskInfo->status == "nodump" || availableDisks.contains(diskInfo);
+}
+
 RomAuditor::RomAuditor(QObject *parent) :
 	QThread(parent),
 	hasAudited(false),
-	method(AUDIT_ONLY)
+	method(AUDIT_ONLY),
+	numThreads(1),
+	hasManifest(false),
+	isIncremental(false),
+	isListShown(false)
 {
 }
 
@@ -194,6 +300,69 @@ void RomAuditor::exportDat()
 	win->poplog("Finished.");
 }
 
+void RomAuditor::loadManifest()
+{
+	QFile file(CFG_PREFIX + "cache/audit.manifest");
+	hasManifest = true;
+
+	if (!file.open(QIODevice::ReadOnly))
+		return;
+
+	QDataStream in(&file);
+	in.setVersion(QDataStream::Qt_4_6);
+
+	quint32 mamepSig;
+	qint16 manifestVersion;
+	in >> mamepSig;
+	in >> manifestVersion;
+	if (mamepSig != MAMEPLUS_SIG || manifestVersion != AUDIT_MANIFEST_VER)
+		return;
+
+	int count;
+	in >> count;
+	for (int i = 0; i < count && in.status() == QDataStream::Ok; i++)
+	{
+		AuditArchive archive;
+		in >> archive.path;
+		in >> archive.gameName;
+		in >> archive.is7z;
+		in >> archive.size;
+		in >> archive.mtime;
+		in >> archive.crcs;
+		archive.changed = false;
+		manifest[archive.path] = archive;
+	}
+
+	if (in.status() != QDataStream::Ok)
+		manifest.clear();
+}
+
+void RomAuditor::saveManifest()
+{
+	QDir().mkpath(CFG_PREFIX + "cache");
+	QSaveFile file(CFG_PREFIX + "cache/audit.manifest");
+	if (!file.open(QIODevice::WriteOnly))
+		return;
+
+	QDataStream out(&file);
+	out << (quint32)MAMEPLUS_SIG;
+	out << (qint16)AUDIT_MANIFEST_VER;
+	out.setVersion(QDataStream::Qt_4_6);
+	out << manifest.size();
+
+	foreach (const AuditArchive &archive, manifest)
+	{
+		out << archive.path;
+		out << archive.gameName;
+		out << archive.is7z;
+		out << archive.size;
+		out << archive.mtime;
+		out << archive.crcs;
+	}
+
+	file.commit();
+}
+
 void RomAuditor::audit(bool autoAudit, int _method, QString fileName)
 {
 	if (isRunning())
@@ -209,17 +378,25 @@ void RomAuditor::audit(bool autoAudit, int _method, QString fileName)
 		return;
 	}
 
-	gameList->disableCtrls();
+	//only the changed rows of a shown list are updated, keeping its scroll position
+	isListShown = !autoAudit && gameListModel != NULL;
 
-	//must clear pMameDat in the main thread
-	// fixme: currently only console games are cleared
-	foreach (QString gameName, pMameDat->games.keys())
+	if (isListShown)
+		win->enableCtrls(false);
+	else
 	{
-		GameInfo *gameInfo = pMameDat->games[gameName];
-		if (gameInfo->isExtRom && gameList->isAuditConsoleFolder(gameInfo->romof))
+		gameList->disableCtrls();
+
+		//must clear pMameDat in the main thread
+		// fixme: currently only console games are cleared
+		foreach (QString gameName, pMameDat->games.keys())
 		{
-			pMameDat->games.remove(gameName);
-			delete gameInfo;
+			GameInfo *gameInfo = pMameDat->games[gameName];
+			if (gameInfo->isExtRom && gameList->isAuditConsoleFolder(gameInfo->romof))
+			{
+				pMameDat->games.remove(gameName);
+				delete gameInfo;
+			}
 		}
 	}
 
@@ -230,40 +407,227 @@ void RomAuditor::audit(bool autoAudit, int _method, QString fileName)
 		isConsoleFolder = false;
 	}
 
+	numThreads = pGuiSettings->value("audit_threads", QThread::idealThreadCount()).toInt();
+	if (numThreads < 1)
+		numThreads = 1;
+
 	hasAudited = true;
+	isIncremental = false;
 	start(LowPriority);
 }
 
-void RomAuditor::run()
+// re-audit only the given rompath dirs and console software
+void RomAuditor::auditPaths(const QStringList &romDirs, const QStringList &consoleNames)
 {
-	GameInfo *gameInfo, *gameInfo2;
-	RomInfo *romInfo;
+	//the manifest and the rom index are loaded on demand, no full audit is needed first
+	if (isRunning())
+		return;
 
-	//audit MAME
-	if(!isConsoleFolder)
+	dirtyRomDirs = romDirs;
+	dirtyConsoles = consoleNames;
+	isIncremental = true;
+	start(LowPriority);
+}
+
+// fill archive info of a rom file of a known game, crcs are replayed from the manifest if unchanged
+bool RomAuditor::initArchive(AuditArchive &archive, const QString &dirPath, const QFileInfo &romFile)
+{
+	QString fullRomName = romFile.fileName().toLower();
+
+	if(fullRomName.contains(ZIP_EXT))
 	{
-		QSet<QString> auditedGames;
+		archive.gameName = fullRomName.remove(ZIP_EXT);
+		archive.is7z = false;
+	}
+	else if(fullRomName.contains(SZIP_EXT))
+	{
+		archive.gameName = fullRomName.remove(SZIP_EXT);
+		archive.is7z = true;
+	}
+	else
+		return false;
 
-		//clear current state
-		foreach (QString gameName, pMameDat->games.keys())
+	if (!pMameDat->games.contains(archive.gameName))
+		return false;
+
+	archive.path = dirPath + romFile.fileName();
+	archive.size = romFile.size();
+	archive.mtime = romFile.lastModified().toMSecsSinceEpoch();
+
+	//replay unchanged archives from the manifest
+	if (manifest.contains(archive.path))
+	{
+		const AuditArchive &archive0 = manifest[archive.path];
+		archive.changed = archive0.size != archive.size || archive0.mtime != archive.mtime;
+		if (!archive.changed)
+			archive.crcs = archive0.crcs;
+	}
+	else
+		archive.changed = true;
+
+	return true;
+}
+
+// decide game status from the rom and disk states, shared by full and incremental audit
+// only stages the rom states and the status in the result
+void RomAuditor::stageGameStatus(const QString &gameName, GameInfo *gameInfo, bool isAudited,
+	const QSet<RomInfo *> &inheritedRoms, AuditResult &result)
+{
+	int available;
+
+	//if game rom file exists, default to passed, if not, skip and fail it
+	if (isAudited)
+		available = GAME_COMPLETE;
+	else
+	{
+		//fail unless: 1. all roms are nodump; 2. all roms are available in parent
+		bool allNoDump = true;
+		bool allinParent = true;
+
+		foreach (RomInfo *romInfo, gameInfo->roms)
 		{
-			gameInfo = pMameDat->games[gameName];
+			//clone rom is already partially supplied by parent
+			if (!result.isRomAvailable(romInfo))
+			{
+				allinParent = false;
+				break;
+			}
+		}
+
+		foreach (RomInfo *romInfo, gameInfo->roms)
+		{
+			if (romInfo->status != "nodump")
+			{
+				allNoDump = false;
+				break;
+			}
+		}
+
+		available = (!allNoDump && !allinParent && gameInfo->disks.isEmpty()) ? GAME_MISSING : GAME_COMPLETE;
+	}
+
+	//iterate disks
+	foreach (DiskInfo *diskInfo, gameInfo->disks)
+	{
+		if (!result.isDiskAvailable(diskInfo))
+			available = GAME_MISSING;
+	}
+
+	//iterate roms
+	foreach (RomInfo *romInfo, gameInfo->roms)
+	{
+		//game rom passed
+		if (result.isRomAvailable(romInfo))
+			continue;
+
+		//parent or bios rom passed
+		if (inheritedRoms.contains(romInfo))
+		{
+			result.availableRoms.insert(romInfo);
+			continue;
+		}
+
+		//failed audit
+		available = GAME_MISSING;
+	}
+
+	result.statuses[gameName] = available;
+}
+
+// hand the result over to the main thread
+void RomAuditor::stageResult(const AuditResult &result)
+{
+	mutex.lock();
+	stagedResults << result;
+	mutex.unlock();
+
+	QMetaObject::invokeMethod(this, "applyResults", Qt::QueuedConnection);
+}
+
+// runs in the main thread, nothing else writes audit states, so the view never sees them half done
+void RomAuditor::applyResults()
+{
+	//the game list is being built from the dat, the results are applied after the swap
+	if (gameList->isBuildingModel())
+		return;
+
+	mutex.lock();
+	QList<AuditResult> results = stagedResults;
+	stagedResults.clear();
+	mutex.unlock();
+
+	foreach (const AuditResult &result, results)
+	{
+		//the dat has been reloaded since
+		if (result.dat != pMameDat)
+			continue;
+
+		QStringList changedGames;
+		QHashIterator<QString, int> it(result.statuses);
+		while (it.hasNext())
+		{
+			it.next();
+			GameInfo *gameInfo = pMameDat->games.value(it.key());
+			if (gameInfo == NULL)
+				continue;
 
 			foreach (RomInfo *romInfo, gameInfo->roms)
-				if (romInfo->status == "nodump")
-					romInfo->available = true;
-				else
-					romInfo->available = false;
+				romInfo->available = result.isRomAvailable(romInfo);
 
-			foreach (DiskInfo *diskInfo, gameInfo->disks)
+			if (result.hasDisks)
 			{
-				if (diskInfo->status == "nodump")
-					diskInfo->available = true;
-				else
-					diskInfo->available = false;
+				foreach (DiskInfo *diskInfo, gameInfo->disks)
+					diskInfo->available = result.isDiskAvailable(diskInfo);
+			}
+
+			if (gameInfo->available != it.value())
+			{
+				gameInfo->available = it.value();
+				changedGames << it.key();
 			}
 		}
 
+		win->log(QString("audit: %1 games changed").arg(changedGames.size()));
+
+		if (!changedGames.isEmpty())
+			emit gamesAudited(changedGames);
+	}
+}
+
+void RomAuditor::run()
+{
+	GameInfo *gameInfo, *gameInfo2;
+
+	if (isIncremental)
+	{
+		auditIncremental();
+		return;
+	}
+
+	//audit MAME
+	if(!isConsoleFolder)
+	{
+		QSet<QString> auditedGames;
+
+		//roms and disks start unavailable, the main thread applies the whole result at once
+		AuditResult result;
+		result.hasDisks = true;
+
+		//7z crc table is global, init it before any worker uses it
+		CrcGenerateTable();
+
+		if (!hasManifest)
+			loadManifest();
+
+		//roms that are available in romof parent or bios
+		QSet<RomInfo *> inheritedRoms;
+		if (pMameDat->romIndex.isEmpty())
+			pMameDat->buildRomIndex();
+
+		//archives that are gone drop out of the manifest
+		QHash<QString, AuditArchive> newManifest;
+		int numRead = 0;
+
 		QStringList dirPaths = mameOpts["rompath"]->currvalue.split(";");
 		//iterate rompaths
 		foreach (QString dirPath, dirPaths)
@@ -271,11 +635,9 @@ void RomAuditor::run()
 			QDir dir(dirPath);
 			QStringList nameFilter = QStringList() << "*" ZIP_EXT;
 			nameFilter<<"*" SZIP_EXT;
-			QStringList romFiles = dir.entryList(nameFilter, QDir::Files | QDir::Readable | QDir::Hidden);
+			QFileInfoList romFiles = dir.entryInfoList(nameFilter, QDir::Files | QDir::Readable | QDir::Hidden);
 			QStringList romDirs = dir.entryList(QStringList(), QDir::AllDirs | QDir::NoDotAndDotDot | QDir::Readable | QDir::Hidden);
 
-			emit progressSwitched(romFiles.size(), QString(tr("Auditing %1 ...")).arg(dir.dirName() + "/"));
-
 			//iterate gameName/*.chd files
 			foreach (QString romDir, romDirs)
 			{
@@ -300,254 +662,292 @@ void RomAuditor::run()
 
 						if (diskInfo->name == fileInfo.baseName().toLower())
 						{
-							diskInfo->available = true;
+							result.availableDisks.insert(diskInfo);
 
 							//also fill clones
 							foreach (QString cloneName, gameInfo->clones)
 							{
 								gameInfo2 = pMameDat->games[cloneName];
 								if (gameInfo2->disks.contains(sha1))
-									gameInfo2->disks[sha1]->available = true;
+									result.availableDisks.insert(gameInfo2->disks[sha1]);
 							}
 						}
 					}
 				}
 			}
 
-			//iterate rom files
-			for (int i = 0; i < romFiles.size(); i++)
+			//collect rom files of known games
+			QVector<AuditArchive> archives;
+			archives.reserve(romFiles.size());
+			foreach (QFileInfo romFile, romFiles)
+			{
+				AuditArchive archive;
+				if (!initArchive(archive, utils->getPath(dirPath), romFile))
+					continue;
+
+				archives.append(archive);
+			}
+
+			//read archive directories concurrently, each task fills its own slot
+			QThreadPool pool;
+			QAtomicInt numDone(0);
+			pool.setMaxThreadCount(numThreads);
+			emit progressSwitched(archives.size(), QString(tr("Auditing %1 ...")).arg(dir.dirName() + "/"));
+
+			for (int i = 0; i < archives.size(); i++)
 			{
-				//update progressbar every 10 files
-				if (i % 10 == 0)
-					emit progressUpdated(i);
-				QString fullRomName = romFiles[i].toLower();
-				if(fullRomName.contains(ZIP_EXT))
+				if (archives[i].changed)
 				{
-					QString gameName = fullRomName.remove(ZIP_EXT);
+					pool.start(new AuditArchiveTask(&archives[i], &numDone));
+					numRead++;
+				}
+				else
+					numDone.fetchAndAddRelaxed(1);
+			}
 
-					if (!pMameDat->games.contains(gameName))
-						continue;
+			while (!pool.waitForDone(100))
+				emit progressUpdated(numDone.load());
 
-					gameInfo = pMameDat->games[gameName];
-					auditedGames.insert(gameName);
+			//merge results
+			foreach (const AuditArchive &archive, archives)
+			{
+				newManifest[archive.path] = archive;
 
-					//open zip file
-					QuaZip zip(utils->getPath(dirPath) + romFiles[i]);
-					if(!zip.open(QuaZip::mdUnzip))
-						continue;
+				gameInfo = pMameDat->games[archive.gameName];
+				auditedGames.insert(archive.gameName);
 
-					QuaZipFileInfo zipFileInfo;
-					QuaZipFile zipFile(&zip);
+				//clones are audited along with a non-empty parent archive
+				if (!archive.crcs.isEmpty())
+					auditedGames.unite(gameInfo->clones);
 
-					//iterate all files in the zip
-					for(bool more=zip.goToFirstFile(); more; more=zip.goToNextFile())
+				foreach (quint32 crc, archive.crcs)
+				{
+					//fill all roms this archive supplies
+					const QVector<RomSlot> slots = pMameDat->romIndex.value(crc);
+					foreach (const RomSlot &slot, slots)
 					{
-						if(!zip.getCurrentFileInfo(&zipFileInfo))
+						if (slot.supplier != gameInfo)
 							continue;
 
-						//fill rom available status if crc recognized
-						if (gameInfo->roms.contains(zipFileInfo.crc))
-							gameInfo->roms.value(zipFileInfo.crc)->available = true;
-
-						//check if rom belongs to a clone
-						foreach (QString cloneName, gameInfo->clones)
-						{
-							auditedGames.insert(cloneName);
-							gameInfo2 = pMameDat->games[cloneName];
-							if (gameInfo2->roms.contains(zipFileInfo.crc))
-								gameInfo2->roms.value(zipFileInfo.crc)->available = true;
-						}
+						if (slot.isDirect)
+							result.availableRoms.insert(slot.romInfo);
+						else
+							inheritedRoms.insert(slot.romInfo);
 					}
 				}
-				else if(fullRomName.contains(SZIP_EXT))
-				{
-					QString gameName = fullRomName.remove(SZIP_EXT);
+			}
+		}
+
+		win->log(QString("audit: %1 archives read, %2 replayed from manifest")
+			.arg(numRead).arg(newManifest.size() - numRead));
+		manifest = newManifest;
+		saveManifest();
+
+//		win->log(QString("audit 1.gamecount %1").arg(pMameDat->games.size()));
+
+		/* see if any rom of a game is not available */
+		//iterate games
+		foreach (QString gameName, pMameDat->games.keys())
+		{
+			gameInfo = pMameDat->games[gameName];
+			//fixme: skip auditing for consoles
+			if (gameInfo->isExtRom)
+				continue;
+
+			stageGameStatus(gameName, gameInfo, auditedGames.contains(gameName), inheritedRoms, result);
+		}
+
+		stageResult(result);
+	}
+//	win->log("finished auditing MAME games.");
 
-					if (!pMameDat->games.contains(gameName))
-						continue;
+	//audit each MESS system
+	QStringList consoleNames;
+	foreach (QString gameName, pMameDat->games.keys())
+	{
+		GameInfo *gameInfo = pMameDat->games[gameName];
+		if (!gameInfo->devices.isEmpty() && gameList->isAuditConsoleFolder(gameName))
+			consoleNames << gameName;
+	}
 
-					gameInfo = pMameDat->games[gameName];
-					auditedGames.insert(gameName);
+	//the main thread adds and removes the ext roms, shown or not
+	scanConsoles(consoleNames);
+//	win->log("finished auditing MESS systems.");
 
-					CFileInStream archiveStream;
-					CLookToRead lookStream;
-					CSzArEx db;
-					SRes res;
-					ISzAlloc allocImp;
-					ISzAlloc allocTempImp;
+	emit progressSwitched(-1);
+	emit audited();
+}
 
-					if (InFile_Open(&archiveStream.file,  qPrintable(utils->getPath(dirPath) + romFiles[i])))
-						continue;
+// re-read changed archives of dirty rompath dirs and update the games using them
+void RomAuditor::auditIncremental()
+{
+	GameInfo *gameInfo;
 
-					FileInStream_CreateVTable(&archiveStream);
-					LookToRead_CreateVTable(&lookStream, False);
+	if (!hasManifest)
+		loadManifest();
 
-					lookStream.realStream = &archiveStream.s;
-					LookToRead_Init(&lookStream);
+	if (pMameDat->romIndex.isEmpty())
+		pMameDat->buildRomIndex();
 
-					allocImp.Alloc = SzAlloc;
-					allocImp.Free = SzFree;
+	CrcGenerateTable();
 
-					allocTempImp.Alloc = SzAllocTemp;
-					allocTempImp.Free = SzFreeTemp;
+	QSet<QString> changedGames;
+	int numRead = 0;
 
-					CrcGenerateTable();
+	foreach (QString dirPath, dirtyRomDirs)
+	{
+		const QString prefix = utils->getPath(dirPath);
+		QDir dir(dirPath);
+		QStringList nameFilter = QStringList() << "*" ZIP_EXT;
+		nameFilter<<"*" SZIP_EXT;
+		QFileInfoList romFiles = dir.entryInfoList(nameFilter, QDir::Files | QDir::Readable | QDir::Hidden);
+		QSet<QString> presentPaths;
+		QAtomicInt numDone(0);
+
+		foreach (QFileInfo romFile, romFiles)
+		{
+			AuditArchive archive;
+			if (!initArchive(archive, prefix, romFile))
+				continue;
 
-					SzArEx_Init(&db);
-					res = SzArEx_Open(&db, &lookStream.s, &allocImp, &allocTempImp);
+			presentPaths.insert(archive.path);
+			if (!archive.changed)
+				continue;
 
-					if (res == SZ_OK)
-					{
-						UInt32 i;
-						Byte *outBuffer = 0; /* it must be 0 before first call for each new archive. */
+			AuditArchiveTask(&archive, &numDone).run();
+			numRead++;
 
-						for (i = 0; i < db.db.NumFiles; i++)
-						{
-							CSzFileItem *f = db.db.Files + i;
-							//fill rom available status if crc recognized
-							if (gameInfo->roms.contains(f->FileCRC))
-								gameInfo->roms.value(f->FileCRC)->available = true;
+			manifest[archive.path] = archive;
+			changedGames.insert(archive.gameName);
+		}
 
-							//check if rom belongs to a clone
-							foreach (QString cloneName, gameInfo->clones)
-							{
-								auditedGames.insert(cloneName);
-								gameInfo2 = pMameDat->games[cloneName];
-								if (gameInfo2->roms.contains(f->FileCRC))
-									gameInfo2->roms.value(f->FileCRC)->available = true;
-							}
+		//drop archives that are gone
+		foreach (QString path, manifest.keys())
+		{
+			if (QFileInfo(path).path() + "/" != prefix || presentPaths.contains(path))
+				continue;
 
-						}
-						IAlloc_Free(&allocImp, outBuffer);
-					}
-					SzArEx_Free(&db, &allocImp);
-					File_Close(&archiveStream.file);
-				}
-			}
+			changedGames.insert(manifest[path].gameName);
+			manifest.remove(path);
 		}
+	}
 
-//		win->log(QString("audit 1.gamecount %1").arg(pMameDat->games.size()));
+	if (!changedGames.isEmpty())
+	{
+		saveManifest();
+		win->log(QString("audit: %1 archives read, %2 games changed").arg(numRead).arg(changedGames.size()));
+	}
 
-		/* see if any rom of a game is not available */
-		//iterate games
+	//archives of each game in rompath
+	QMultiHash<QString, QString> gameArchives;
+	foreach (const AuditArchive &archive, manifest)
+		gameArchives.insert(archive.gameName, archive.path);
+
+	AuditResult result;
+	if (!changedGames.isEmpty())
+	{
 		foreach (QString gameName, pMameDat->games.keys())
 		{
 			gameInfo = pMameDat->games[gameName];
-			//fixme: skip auditing for consoles
 			if (gameInfo->isExtRom)
 				continue;
 
-			//if game rom file exists, default to passed, if not, skip and fail it
-			if (auditedGames.contains(gameName))
-				gameInfo->available = GAME_COMPLETE;
-			else
+			//archives that can supply roms of this game, same as the rom index
+			QStringList suppliers;
+			suppliers << gameName << gameInfo->cloneof;
+			if (pMameDat->games.contains(gameInfo->romof))
 			{
-				//fail unless: 1. all roms are nodump; 2. all roms are available in parent
-				bool allNoDump = true;
-				bool allinParent = true;
-
-				foreach (RomInfo *romInfo, gameInfo->roms)
-				{
-					//clone romInfo->available is already partially supplied by parent
-					if (!romInfo->available)
-					{
-						allinParent = false;
-						break;
-					}
-				}
-
-				foreach (RomInfo *romInfo, gameInfo->roms)
-				{
-					if (romInfo->status != "nodump")
-					{
-						allNoDump = false;
-						break;
-					}
-				}
-
-				gameInfo->available = (!allNoDump && !allinParent && gameInfo->disks.isEmpty()) ? GAME_MISSING : GAME_COMPLETE;
+				GameInfo *romofInfo = pMameDat->games[gameInfo->romof];
+				suppliers << gameInfo->romof << romofInfo->cloneof;
+				if (pMameDat->games.contains(romofInfo->romof))
+					suppliers << romofInfo->romof << pMameDat->games[romofInfo->romof]->cloneof;
 			}
 
-			//iterate disks
-			foreach (DiskInfo *diskInfo, gameInfo->disks)
-			{
-				if (!diskInfo->available)
-					gameInfo->available = GAME_MISSING;
-			}
+			bool isAffected = false;
+			foreach (QString supplier, suppliers)
+				if (changedGames.contains(supplier))
+					isAffected = true;
 
-			//iterate roms
-			foreach (quint32 crc, gameInfo->roms.keys())
-			{
-				romInfo = gameInfo->roms.value(crc);
+			if (!isAffected)
+				continue;
 
-				//game rom passed
-				if (romInfo->available)
+			QSet<RomInfo *> inheritedRoms;
+			foreach (QString supplier, suppliers)
+			{
+				if (supplier.isEmpty() || !pMameDat->games.contains(supplier))
 					continue;
 
-				if (!gameInfo->romof.isEmpty())
+				GameInfo *supplierInfo = pMameDat->games[supplier];
+				foreach (QString path, gameArchives.values(supplier))
 				{
-					//check parent
-					gameInfo2 = pMameDat->games[gameInfo->romof];
-
-					//parent rom passed
-					if (gameInfo2->roms.contains(crc) && gameInfo2->roms.value(crc)->available)
+					foreach (quint32 crc, manifest[path].crcs)
 					{
-						romInfo->available = true;
-						continue;
-					}
-
-					//check bios
-					if (!gameInfo2->romof.isEmpty())
-					{
-						gameInfo2 = pMameDat->games[gameInfo2->romof];
-
-						//bios rom passed
-						if (gameInfo2->roms.contains(crc) && gameInfo2->roms.value(crc)->available)
+						const QVector<RomSlot> slots = pMameDat->romIndex.value(crc);
+						foreach (const RomSlot &slot, slots)
 						{
-							romInfo->available = true;
-							continue;
+							if (slot.supplier != supplierInfo || slot.gameName != gameName)
+								continue;
+
+							if (slot.isDirect)
+								result.availableRoms.insert(slot.romInfo);
+							else
+								inheritedRoms.insert(slot.romInfo);
 						}
 					}
 				}
-
-				//failed audit
-				gameInfo->available = GAME_MISSING;
 			}
+
+			//clones are audited along with a non-empty parent archive
+			bool isAudited = gameArchives.contains(gameName);
+			foreach (QString path, gameArchives.values(gameInfo->cloneof))
+				if (!manifest[path].crcs.isEmpty())
+					isAudited = true;
+
+			stageGameStatus(gameName, gameInfo, isAudited, inheritedRoms, result);
 		}
 	}
-//	win->log("finished auditing MAME games.");
 
-	pMameDat->completeData();
+	if (!result.statuses.isEmpty())
+		stageResult(result);
 
-	//audit each MESS system
-	foreach (QString gameName, pMameDat->games.keys())
+	scanConsoles(dirtyConsoles);
+}
+
+// list the software of consoles, the main thread syncs it to the dat and the shown list
+void RomAuditor::scanConsoles(const QStringList &consoleNames)
+{
+	QStringList scannedNames;
+	QList<QStringList> keysList, descriptionsList;
+
+	//the main thread changes pMameDat as soon as ext roms are reported, so scan all first
+	foreach (QString consoleName, consoleNames)
 	{
-		GameInfo *gameInfo = pMameDat->games[gameName];
-		if (!gameInfo->devices.isEmpty())
-		{
-			if (!gameList->isAuditConsoleFolder(gameName))
-				continue;
+		QStringList keys, descriptions;
 
-			auditConsole(gameName);
-		}
+		if (!pMameDat->games.contains(consoleName))
+			continue;
+
+		scanConsole(consoleName, keys, descriptions);
+		scannedNames << consoleName;
+		keysList << keys;
+		descriptionsList << descriptions;
 	}
-//	win->log("finished auditing MESS systems.");
 
-	emit progressSwitched(-1);
+	for (int i = 0; i < scannedNames.size(); i++)
+		emit extRomsAudited(scannedNames[i], keysList[i], descriptionsList[i]);
 }
 
-// must be static func in a thread
-void RomAuditor::auditConsole(QString consoleName)
+// list the software of a console, keys are the game names of ext roms
+bool RomAuditor::scanConsole(const QString &consoleName, QStringList &keys, QStringList &descriptions)
 {
 	QString _dirpath = mameOpts[consoleName + "_extra_software"]->globalvalue;
 	QDir dir(_dirpath);
 	if (_dirpath.isEmpty() || !dir.exists())
-		return;
+		return false;
 
 	QString dirPath = utils->getPath(_dirpath);
 
 	GameInfo *gameInfo = pMameDat->games[consoleName];
-	QString sourcefile = gameInfo->sourcefile;
 
 	QStringList nameFilters;
 	foreach (DeviceInfo *deviceInfo, gameInfo->devices)
@@ -577,35 +977,101 @@ void RomAuditor::auditConsole(QString consoleName)
 			{
 				QFileInfo zipFileInfo(zipFileName);
 
-				gameInfo = new GameInfo(pMameDat);
-				gameInfo->description = zipFileInfo.completeBaseName();
-				gameInfo->isExtRom = true;
-				gameInfo->romof = consoleName;
-				gameInfo->sourcefile = sourcefile;
-				gameInfo->available = GAME_COMPLETE;
-
-				QString key = dirPath + fileName + "/" + zipFileName;
-				pMameDat->games[key] = gameInfo;
+				keys << dirPath + fileName + "/" + zipFileName;
+				descriptions << zipFileInfo.completeBaseName();
 			}
 
 			utils->clearMameFileInfoList(mameFileInfoList);
 		}
 		else
 		{
-			gameInfo = new GameInfo(pMameDat);
-			gameInfo->description = fi.completeBaseName();
-			gameInfo->isExtRom = true;
-			gameInfo->romof = consoleName;
-			gameInfo->sourcefile = sourcefile;
-			gameInfo->available = GAME_COMPLETE;
-
-			pMameDat->games[dirPath + fileName] = gameInfo;
+			keys << dirPath + fileName;
+			descriptions << fi.completeBaseName();
 		}
 
 		if (i % 10 == 0)
 			emit progressUpdated(i);
 	}
 	emit progressSwitched(-1);
+
+	return true;
+}
+
+
+RomWatcher::RomWatcher(QObject *parent) :
+	QObject(parent)
+{
+	//coalesce bursts of changes, e.g. copying many archives
+	timer.setSingleShot(true);
+	timer.setInterval(500);
+
+	connect(&watcher, SIGNAL(directoryChanged(const QString &)), this, SLOT(directoryChanged(const QString &)));
+	connect(&timer, SIGNAL(timeout()), this, SLOT(flush()));
+}
+
+// (re)watch rompath and software dirs of consoles
+void RomWatcher::watch()
+{
+	if (!watcher.directories().isEmpty())
+		watcher.removePaths(watcher.directories());
+	watchedPaths.clear();
+	dirtyPaths.clear();
+
+	//keep paths as the auditor spells them, so they match the manifest
+	QStringList dirPaths = mameOpts["rompath"]->currvalue.split(";");
+	foreach (QString dirPath, dirPaths)
+	{
+		dirPath = utils->getPath(dirPath);
+		dirPath.chop(1);
+		if (!dirPath.isEmpty() && QDir(dirPath).exists())
+			watchedPaths[dirPath] = "";
+	}
+
+	foreach (QString gameName, pMameDat->games.keys())
+	{
+		GameInfo *gameInfo = pMameDat->games[gameName];
+		if (gameInfo->devices.isEmpty() || !mameOpts.contains(gameName + "_extra_software"))
+			continue;
+
+		QString dirPath = mameOpts[gameName + "_extra_software"]->globalvalue;
+		if (!dirPath.isEmpty() && QDir(dirPath).exists())
+			watchedPaths[dirPath] = gameName;
+	}
+
+	if (!watchedPaths.isEmpty())
+		watcher.addPaths(watchedPaths.keys());
+}
+
+void RomWatcher::directoryChanged(const QString &path)
+{
+	dirtyPaths.insert(path);
+	timer.start();
+}
+
+void RomWatcher::flush()
+{
+	//try again when the current audit or the model building is done
+	if (win->romAuditor->isRunning() || gameList->isBuildingModel())
+	{
+		timer.start();
+		return;
+	}
+
+	QStringList romDirs, consoleNames;
+	foreach (QString path, dirtyPaths)
+	{
+		if (!watchedPaths.contains(path))
+			continue;
+
+		if (watchedPaths[path].isEmpty())
+			romDirs << path;
+		else
+			consoleNames << watchedPaths[path];
+	}
+	dirtyPaths.clear();
+
+	if (!romDirs.isEmpty() || !consoleNames.isEmpty())
+		win->romAuditor->auditPaths(romDirs, consoleNames);
 }
 
 
@@ -20,6 +20,41 @@ enum
 	VERIFY_ALL_SAMPLES
 };
 
+#define AUDIT_MANIFEST_VER 1
+
+// an archive in rompath and the crcs of its entries
+class AuditArchive
+{
+public:
+	QString gameName;
+	QString path;
+	bool is7z;
+	qint64 size;
+	qint64 mtime;
+	bool changed;
+	QList<quint32> crcs;
+};
+
+class GameInfo;
+class RomInfo;
+class DiskInfo;
+class MameDat;
+
+// audit results computed in the auditor thread, written to the dat in the main thread
+class AuditResult
+{
+public:
+	MameDat *dat;
+	QHash<QString, int> statuses;	//new status of each audited game
+	QSet<RomInfo *> availableRoms;
+	QSet<DiskInfo *> availableDisks;
+	bool hasDisks;	//disk states are staged as well
+
+	AuditResult();
+	bool isRomAvailable(RomInfo *) const;
+	bool isDiskAvailable(DiskInfo *) const;
+};
+
 class RomAuditor : public QThread
 {
 Q_OBJECT
@@ -28,6 +63,7 @@ public:
 	RomAuditor(QObject *parent = 0);
 	~RomAuditor();
 	void audit(bool = false, int = AUDIT_ONLY, QString = "");
+	void auditPaths(const QStringList &, const QStringList &);
 
 public slots:
 	void exportDat();
@@ -36,18 +72,60 @@ signals:
 	void progressSwitched(int max, QString title = "");
 	void progressUpdated(int progress);
 	void logUpdated(char, QString);
+	void audited();
+	void gamesAudited(const QStringList &);
+	void extRomsAudited(const QString &, const QStringList &, const QStringList &);
 
 protected:
 	void run();
 
+private slots:
+	void applyResults();
+
 private:
-	void auditConsole(QString);
+	bool scanConsole(const QString &, QStringList &, QStringList &);
+	void scanConsoles(const QStringList &);
+	void auditIncremental();
+	bool initArchive(AuditArchive &, const QString &, const QFileInfo &);
+	void stageGameStatus(const QString &, GameInfo *, bool, const QSet<RomInfo *> &, AuditResult &);
+	void stageResult(const AuditResult &);
+	void loadManifest();
+	void saveManifest();
 
 	bool isConsoleFolder;
 	bool hasAudited;
 	int method;
+	int numThreads;
+	bool hasManifest;
+	bool isIncremental;
+	//a shown list is updated in place instead of being built again
+	bool isListShown;
+	QStringList dirtyRomDirs;
+	QStringList dirtyConsoles;
+	QHash<QString, AuditArchive> manifest;
 	QString fixDatFileName;
 	QMutex mutex;
+	QList<AuditResult> stagedResults;
+};
+
+// watches rompath and console software dirs and re-audits what changed
+class RomWatcher : public QObject
+{
+Q_OBJECT
+
+public:
+	RomWatcher(QObject *parent = 0);
+	void watch();
+
+private slots:
+	void directoryChanged(const QString &);
+	void flush();
+
+private:
+	QFileSystemWatcher watcher;
+	QTimer timer;
+	QHash<QString /*path*/, QString /*consoleName*/> watchedPaths;
+	QSet<QString> dirtyPaths;
 };
 
 class MameExeRomAuditor : public QObject
@@ -0,0 +1,884 @@
+#include <QSaveFile>
+#include "gamecache.h"
+#include "prototype.h"
+#include "mainwindow.h"
+
+static const int sectionItemSize[CACHE_SECTION_LAST] =
+{
+	sizeof(CacheGame),
+	sizeof(CacheBiosSet),
+	sizeof(CacheRom),
+	sizeof(CacheDisk),
+	sizeof(CacheChip),
+	sizeof(CacheSoftwareList),
+	sizeof(CacheDisplay),
+	sizeof(CacheControl),
+	sizeof(CacheDevice),
+	sizeof(CacheRef),
+	sizeof(quint32),
+	1,
+	sizeof(QChar)
+};
+
+// collects records and strings while encoding
+class CacheBuilder
+{
+public:
+	QString strings;
+	QHash<QString, CacheRef> stringMap;
+	QByteArray blobs;
+	QVector<CacheGame> games;
+	QVector<CacheBiosSet> biosSets;
+	QVector<CacheRom> roms;
+	QVector<CacheDisk> disks;
+	QVector<CacheChip> chips;
+	QVector<CacheSoftwareList> softwareLists;
+	QVector<CacheDisplay> displays;
+	QVector<CacheControl> controls;
+	QVector<CacheDevice> devices;
+	QVector<CacheRef> stringRefs;
+	QVector<quint32> ramOptions;
+
+	CacheRef addString(const QString &str)
+	{
+		CacheRef ref = {0, 0};
+
+		if (str.isEmpty())
+			return ref;
+
+		//share identical strings, most of status, region and type values are the same
+		if (stringMap.contains(str))
+			return stringMap.value(str);
+
+		ref.offset = strings.size();
+		ref.length = str.size();
+		strings.append(str);
+		stringMap[str] = ref;
+
+		return ref;
+	}
+
+	CacheRef addBlob(const QByteArray &blob)
+	{
+		CacheRef ref = {(quint32)blobs.size(), (quint32)blob.size()};
+		blobs.append(blob);
+		return ref;
+	}
+
+	CacheRef addStringList(const QStringList &list)
+	{
+		CacheRef ref = {(quint32)stringRefs.size(), (quint32)list.size()};
+		foreach (QString str, list)
+			stringRefs.append(addString(str));
+		return ref;
+	}
+
+	template <typename T>
+	static CacheRef range(const QVector<T> &vector, int first)
+	{
+		CacheRef ref = {(quint32)first, (quint32)(vector.size() - first)};
+		return ref;
+	}
+
+	template <typename T>
+	static void clear(T &item)
+	{
+		memset(&item, 0, sizeof(T));
+	}
+};
+
+// append a section aligned to 8 bytes and record its position
+static void appendSection(QByteArray &buf, CacheHeader *header, int section, const void *items, int count)
+{
+	while (buf.size() % 8)
+		buf.append('\0');
+
+	header->sections[section].offset = buf.size();
+	header->sections[section].length = count;
+	buf.append((const char *)items, count * sectionItemSize[section]);
+}
+
+GameCache::GameCache() :
+	data(NULL),
+	size(0),
+	header(NULL),
+	strings(NULL),
+	stringTable(NULL)
+{
+}
+
+GameCache::~GameCache()
+{
+	close();
+}
+
+int GameCache::open(const QString &fileName)
+{
+	close();
+
+	file.setFileName(fileName);
+	if (!file.open(QIODevice::ReadOnly))
+		return 0;
+
+	size = file.size();
+	if (size < (qint64)(sizeof(quint32) + sizeof(qint16)))
+		return 0;
+
+	data = file.map(0, size);
+	if (data == NULL)
+		return 0;
+
+	if (qFromBigEndian<quint32>(data) != MAMEPLUS_SIG)
+	{
+		win->log(QObject::tr("Cache signature error."));
+		close();
+		return 0;
+	}
+
+	//older stream caches are read by MameDat
+	int version = qFromBigEndian<qint16>(data + sizeof(quint32));
+	if (version != S11N_VER)
+		return version;
+
+	if (size < (qint64)sizeof(CacheHeader))
+	{
+		close();
+		return 0;
+	}
+
+	header = (const CacheHeader *)data;
+	if (header->byteOrder != 0x0102)
+	{
+		close();
+		return 0;
+	}
+
+	//make sure every section is inside the file
+	for (int i = 0; i < CACHE_SECTION_LAST; i++)
+	{
+		const CacheRef &section = header->sections[i];
+		if (section.offset % 8 ||
+			(qint64)section.offset + (qint64)section.length * sectionItemSize[i] > size)
+		{
+			close();
+			return 0;
+		}
+	}
+
+	if (header->sections[CACHE_GAMES].length != header->gameCount)
+	{
+		close();
+		return 0;
+	}
+
+	strings = (const QChar *)(data + header->sections[CACHE_STRINGS].offset);
+
+	return version;
+}
+
+void GameCache::close()
+{
+	if (data != NULL)
+		file.unmap((uchar *)data);
+	file.close();
+
+	data = NULL;
+	size = 0;
+	header = NULL;
+	strings = NULL;
+}
+
+const CacheGame *GameCache::game(int index) const
+{
+	if (header == NULL || index < 0 || index >= (int)header->gameCount)
+		return NULL;
+
+	return (const CacheGame *)(data + header->sections[CACHE_GAMES].offset) + index;
+}
+
+// each string is copied once into the table of the dat, all records using it share the copy
+QString GameCache::string(const CacheRef &ref) const
+{
+	if (ref.length == 0 || header == NULL || stringTable == NULL ||
+		(quint64)ref.offset + ref.length > header->sections[CACHE_STRINGS].length)
+		return QString();
+
+	QHash<quint32, QString>::iterator it = stringTable->find(ref.offset);
+	if (it == stringTable->end())
+		it = stringTable->insert(ref.offset, QString(strings + ref.offset, ref.length));
+
+	return it.value();
+}
+
+QByteArray GameCache::blob(const CacheRef &ref) const
+{
+	if (ref.length == 0 || header == NULL ||
+		(quint64)ref.offset + ref.length > header->sections[CACHE_BLOBS].length)
+		return QByteArray();
+
+	return QByteArray((const char *)data + header->sections[CACHE_BLOBS].offset + ref.offset, ref.length);
+}
+
+const void *GameCache::itemData(int section, const CacheRef &range) const
+{
+	if (header == NULL || range.length == 0 ||
+		(quint64)range.offset + range.length > header->sections[section].length)
+		return NULL;
+
+	return data + header->sections[section].offset + range.offset * sectionItemSize[section];
+}
+
+int GameCache::load(MameDat *pDat)
+{
+	if (header == NULL)
+		return QDataStream::ReadCorruptData;
+
+	//no string refers to the mapped file, so it can be unmapped and rewritten at any time
+	stringTable = &pDat->cacheStrings;
+	stringTable->clear();
+
+	pDat->mameVersion = string(header->mameVersion);
+	pDat->defaultIni = string(header->defaultIni);
+	pDat->games.reserve(header->gameCount);
+
+	for (int i = 0; i < (int)header->gameCount; i++)
+	{
+		const CacheGame *cacheGame = game(i);
+		GameInfo *gameInfo = new GameInfo(pDat);
+		int j;
+
+		/* internal */
+		gameInfo->isExtRom = cacheGame->flags & CACHE_GAME_EXTROM;
+		gameInfo->available = cacheGame->available;
+		gameInfo->extraInfo = blob(cacheGame->extraInfo);
+
+		/* game */
+		gameInfo->romof = string(cacheGame->romof);
+		gameInfo->description = string(cacheGame->description);
+		gameInfo->year = string(cacheGame->year);
+		gameInfo->manufacturer = string(cacheGame->manufacturer);
+		gameInfo->cloneof = string(cacheGame->cloneof);
+		gameInfo->sourcefile = string(cacheGame->sourcefile);
+		gameInfo->isBios = cacheGame->flags & CACHE_GAME_BIOS;
+		gameInfo->isDevice = cacheGame->flags & CACHE_GAME_DEVICE;
+		gameInfo->sampleof = string(cacheGame->sampleof);
+		gameInfo->isMechanical = cacheGame->flags & CACHE_GAME_MECHANICAL;
+		gameInfo->isGamble = cacheGame->flags & CACHE_GAME_GAMBLE;
+
+		/* biosset */
+		const CacheBiosSet *cacheBiosSets = items<CacheBiosSet>(CACHE_BIOSSETS, cacheGame->biosSets);
+		for (j = 0; cacheBiosSets != NULL && j < (int)cacheGame->biosSets.length; j++)
+		{
+			BiosSet *biosSet = new BiosSet(gameInfo);
+			biosSet->description = string(cacheBiosSets[j].description);
+			biosSet->isDefault = cacheBiosSets[j].isDefault;
+			gameInfo->biosSets[string(cacheBiosSets[j].name)] = biosSet;
+		}
+
+		/* rom */
+		const CacheRom *cacheRoms = items<CacheRom>(CACHE_ROMS, cacheGame->roms);
+		for (j = 0; cacheRoms != NULL && j < (int)cacheGame->roms.length; j++)
+		{
+			RomInfo *romInfo = new RomInfo(gameInfo);
+			romInfo->name = string(cacheRoms[j].name);
+			romInfo->size = cacheRoms[j].size;
+			romInfo->status = string(cacheRoms[j].status);
+			romInfo->bios = string(cacheRoms[j].bios);
+			romInfo->merge = string(cacheRoms[j].merge);
+			romInfo->region = string(cacheRoms[j].region);
+			gameInfo->roms.insert(cacheRoms[j].crc, romInfo);
+		}
+
+		/* disk */
+		const CacheDisk *cacheDisks = items<CacheDisk>(CACHE_DISKS, cacheGame->disks);
+		for (j = 0; cacheDisks != NULL && j < (int)cacheGame->disks.length; j++)
+		{
+			DiskInfo *diskInfo = new DiskInfo(gameInfo);
+			diskInfo->name = string(cacheDisks[j].name);
+			diskInfo->merge = string(cacheDisks[j].merge);
+			diskInfo->region = string(cacheDisks[j].region);
+			diskInfo->index = cacheDisks[j].index;
+			diskInfo->status = string(cacheDisks[j].status);
+			gameInfo->disks[string(cacheDisks[j].sha1)] = diskInfo;
+		}
+
+		/* sample */
+		const CacheRef *cacheSamples = items<CacheRef>(CACHE_STRINGREFS, cacheGame->samples);
+		for (j = 0; cacheSamples != NULL && j < (int)cacheGame->samples.length; j++)
+			gameInfo->samples << string(cacheSamples[j]);
+
+		/* chip */
+		const CacheChip *cacheChips = items<CacheChip>(CACHE_CHIPS, cacheGame->chips);
+		for (j = 0; cacheChips != NULL && j < (int)cacheGame->chips.length; j++)
+		{
+			ChipInfo *chipInfo = new ChipInfo(gameInfo);
+			chipInfo->name = string(cacheChips[j].name);
+			chipInfo->tag = string(cacheChips[j].tag);
+			chipInfo->type = string(cacheChips[j].type);
+			chipInfo->clock = cacheChips[j].clock;
+			gameInfo->chips.append(chipInfo);
+		}
+
+		/* softwarelist */
+		const CacheSoftwareList *cacheSoftwareLists = items<CacheSoftwareList>(CACHE_SOFTWARELISTS, cacheGame->softwareLists);
+		for (j = 0; cacheSoftwareLists != NULL && j < (int)cacheGame->softwareLists.length; j++)
+		{
+			SoftwareListInfo *softwarelist = new SoftwareListInfo(gameInfo);
+			softwarelist->name = string(cacheSoftwareLists[j].name);
+			softwarelist->status = string(cacheSoftwareLists[j].status);
+			softwarelist->filter = string(cacheSoftwareLists[j].filter);
+			gameInfo->softwarelists.append(softwarelist);
+		}
+
+		/* display */
+		const CacheDisplay *cacheDisplays = items<CacheDisplay>(CACHE_DISPLAYS, cacheGame->displays);
+		for (j = 0; cacheDisplays != NULL && j < (int)cacheGame->displays.length; j++)
+		{
+			DisplayInfo *displayInfo = new DisplayInfo(gameInfo);
+			displayInfo->type = string(cacheDisplays[j].type);
+			displayInfo->rotate = string(cacheDisplays[j].rotate);
+			displayInfo->flipx = cacheDisplays[j].flipx;
+			displayInfo->width = cacheDisplays[j].width;
+			displayInfo->height = cacheDisplays[j].height;
+			displayInfo->refresh = string(cacheDisplays[j].refresh);
+			displayInfo->htotal = cacheDisplays[j].htotal;
+			displayInfo->hbend = cacheDisplays[j].hbend;
+			displayInfo->hbstart = cacheDisplays[j].hbstart;
+			displayInfo->vtotal = cacheDisplays[j].vtotal;
+			displayInfo->vbend = cacheDisplays[j].vbend;
+			displayInfo->vbstart = cacheDisplays[j].vbstart;
+			gameInfo->displays.append(displayInfo);
+		}
+
+		/* sound */
+		gameInfo->channels = cacheGame->channels;
+
+		/* input */
+		gameInfo->service = cacheGame->flags & CACHE_GAME_SERVICE;
+		gameInfo->tilt = cacheGame->flags & CACHE_GAME_TILT;
+		gameInfo->players = cacheGame->players;
+		gameInfo->buttons = cacheGame->buttons;
+		gameInfo->coins = cacheGame->coins;
+
+		const CacheControl *cacheControls = items<CacheControl>(CACHE_CONTROLS, cacheGame->controls);
+		for (j = 0; cacheControls != NULL && j < (int)cacheGame->controls.length; j++)
+		{
+			ControlInfo *controlInfo = new ControlInfo(gameInfo);
+			controlInfo->type = string(cacheControls[j].type);
+			controlInfo->minimum = cacheControls[j].minimum;
+			controlInfo->maximum = cacheControls[j].maximum;
+			controlInfo->sensitivity = cacheControls[j].sensitivity;
+			controlInfo->keydelta = cacheControls[j].keydelta;
+			controlInfo->reverse = cacheControls[j].reverse;
+			gameInfo->controls.append(controlInfo);
+		}
+
+		/* driver */
+		gameInfo->status = cacheGame->status;
+		gameInfo->emulation = cacheGame->emulation;
+		gameInfo->color = cacheGame->color;
+		gameInfo->sound = cacheGame->sound;
+		gameInfo->graphic = cacheGame->graphic;
+		gameInfo->cocktail = cacheGame->cocktail;
+		gameInfo->protection = cacheGame->protection;
+		gameInfo->savestate = cacheGame->savestate;
+		gameInfo->palettesize = cacheGame->palettesize;
+
+		/* device */
+		const CacheDevice *cacheDevices = items<CacheDevice>(CACHE_DEVICES, cacheGame->devices);
+		for (j = 0; cacheDevices != NULL && j < (int)cacheGame->devices.length; j++)
+		{
+			DeviceInfo *deviceInfo = new DeviceInfo(gameInfo);
+			deviceInfo->type = string(cacheDevices[j].type);
+			deviceInfo->tag = string(cacheDevices[j].tag);
+			deviceInfo->mandatory = cacheDevices[j].mandatory;
+
+			const CacheRef *cacheExtensions = items<CacheRef>(CACHE_STRINGREFS, cacheDevices[j].extensionNames);
+			for (int k = 0; cacheExtensions != NULL && k < (int)cacheDevices[j].extensionNames.length; k++)
+				deviceInfo->extensionNames << string(cacheExtensions[k]);
+
+			deviceInfo->mountedPath = string(cacheDevices[j].mountedPath);
+			gameInfo->devices.insert(string(cacheDevices[j].instanceName), deviceInfo);
+		}
+
+		/*ramoption */
+		const quint32 *cacheRamOptions = items<quint32>(CACHE_RAMOPTIONS, cacheGame->ramOptions);
+		for (j = 0; cacheRamOptions != NULL && j < (int)cacheGame->ramOptions.length; j++)
+			gameInfo->ramOptions << cacheRamOptions[j];
+		gameInfo->defaultRamOption = cacheGame->defaultRamOption;
+
+		pDat->games.insert(string(cacheGame->name), gameInfo);
+	}
+
+	stringTable = NULL;
+
+	return QDataStream::Ok;
+}
+
+CacheSnapshot::CacheSnapshot()
+{
+}
+
+CacheSnapshot::CacheSnapshot(const MameDat *pDat) :
+	mameVersion(pDat->mameVersion),
+	defaultIni(pDat->defaultIni)
+{
+	games.reserve(pDat->games.size());
+	availables.reserve(pDat->games.size());
+
+	QHashIterator<QString, GameInfo *> it(pDat->games);
+	while (it.hasNext())
+	{
+		it.next();
+		GameInfo *gameInfo = it.value();
+
+		if (gameInfo->isExtRom)
+		{
+			CacheExtRom extRom;
+			extRom.description = gameInfo->description;
+			extRom.romof = gameInfo->romof;
+			extRom.extraInfo = gameInfo->extraInfo;
+			extRoms.insert(games.size(), extRom);
+			games.append(qMakePair(it.key(), (GameInfo *)NULL));
+		}
+		else
+		{
+			foreach (DeviceInfo *deviceInfo, gameInfo->devices)
+				if (!deviceInfo->isConst && !deviceInfo->mountedPath.isEmpty())
+					mountedPaths.insert(deviceInfo, deviceInfo->mountedPath);
+			games.append(qMakePair(it.key(), gameInfo));
+		}
+
+		availables.append(gameInfo->available);
+	}
+}
+
+// changes when anything that can change after loading changes, a fresh dat is saved anyway
+quint64 CacheSnapshot::stamp() const
+{
+	quint64 stamp = qHash(mameVersion) ^ ((quint64)qHash(defaultIni) << 32);
+
+	for (int i = 0; i < games.size(); i++)
+	{
+		stamp = stamp * 31 + qHash(games[i].first);
+		stamp = stamp * 31 + (quint8)availables[i];
+		if (games[i].second == NULL)
+			stamp = stamp * 31 + qHash(extRoms[i].romof + "\t" + extRoms[i].description);
+	}
+
+	QHashIterator<const DeviceInfo *, QString> it(mountedPaths);
+	while (it.hasNext())
+	{
+		it.next();
+		//the hash order is not stable, add up the entries
+		stamp += qHash(it.key()) ^ ((quint64)qHash(it.value()) << 16);
+	}
+
+	return stamp;
+}
+
+QByteArray GameCache::encode(const CacheSnapshot &snapshot)
+{
+	CacheBuilder builder;
+
+	builder.games.reserve(snapshot.games.size());
+
+	for (int i = 0; i < snapshot.games.size(); i++)
+	{
+		GameInfo *gameInfo = snapshot.games[i].second;
+		CacheGame cacheGame;
+		CacheBuilder::clear(cacheGame);
+		int first;
+
+		cacheGame.name = builder.addString(snapshot.games[i].first);
+
+		/* internal */
+		cacheGame.available = snapshot.availables[i];
+
+		//ext roms only keep what identifies them
+		if (gameInfo == NULL)
+		{
+			const CacheExtRom &extRom = snapshot.extRoms[i];
+			cacheGame.extraInfo = builder.addBlob(extRom.extraInfo);
+			cacheGame.flags |= CACHE_GAME_EXTROM;
+			cacheGame.romof = builder.addString(extRom.romof);
+			cacheGame.description = builder.addString(extRom.description);
+			builder.games.append(cacheGame);
+			continue;
+		}
+
+		cacheGame.extraInfo = builder.addBlob(gameInfo->extraInfo);
+
+		/* game */
+		cacheGame.romof = builder.addString(gameInfo->romof);
+		cacheGame.description = builder.addString(gameInfo->description);
+		cacheGame.year = builder.addString(gameInfo->year);
+		cacheGame.manufacturer = builder.addString(gameInfo->manufacturer);
+
+		/* rom */
+		first = builder.roms.size();
+		QHashIterator<quint32, RomInfo *> romIt(gameInfo->roms);
+		while (romIt.hasNext())
+		{
+			romIt.next();
+			RomInfo *romInfo = romIt.value();
+			CacheRom cacheRom;
+			CacheBuilder::clear(cacheRom);
+			cacheRom.crc = romIt.key();
+			cacheRom.name = builder.addString(romInfo->name);
+			cacheRom.size = romInfo->size;
+			cacheRom.status = builder.addString(romInfo->status);
+			cacheRom.bios = builder.addString(romInfo->bios);
+			cacheRom.merge = builder.addString(romInfo->merge);
+			cacheRom.region = builder.addString(romInfo->region);
+			builder.roms.append(cacheRom);
+		}
+		cacheGame.roms = CacheBuilder::range(builder.roms, first);
+
+		cacheGame.cloneof = builder.addString(gameInfo->cloneof);
+		cacheGame.sourcefile = builder.addString(gameInfo->sourcefile);
+		cacheGame.sampleof = builder.addString(gameInfo->sampleof);
+		if (gameInfo->isBios)
+			cacheGame.flags |= CACHE_GAME_BIOS;
+		if (gameInfo->isDevice)
+			cacheGame.flags |= CACHE_GAME_DEVICE;
+		if (gameInfo->isMechanical)
+			cacheGame.flags |= CACHE_GAME_MECHANICAL;
+		if (gameInfo->isGamble)
+			cacheGame.flags |= CACHE_GAME_GAMBLE;
+
+		/* biosset */
+		first = builder.biosSets.size();
+		foreach (QString name, gameInfo->biosSets.keys())
+		{
+			BiosSet *biosSet = gameInfo->biosSets[name];
+			CacheBiosSet cacheBiosSet;
+			CacheBuilder::clear(cacheBiosSet);
+			cacheBiosSet.name = builder.addString(name);
+			cacheBiosSet.description = builder.addString(biosSet->description);
+			cacheBiosSet.isDefault = biosSet->isDefault;
+			builder.biosSets.append(cacheBiosSet);
+		}
+		cacheGame.biosSets = CacheBuilder::range(builder.biosSets, first);
+
+		/* disk */
+		first = builder.disks.size();
+		foreach (QString sha1, gameInfo->disks.keys())
+		{
+			DiskInfo *diskInfo = gameInfo->disks[sha1];
+			CacheDisk cacheDisk;
+			CacheBuilder::clear(cacheDisk);
+			cacheDisk.sha1 = builder.addString(sha1);
+			cacheDisk.name = builder.addString(diskInfo->name);
+			cacheDisk.merge = builder.addString(diskInfo->merge);
+			cacheDisk.region = builder.addString(diskInfo->region);
+			cacheDisk.index = diskInfo->index;
+			cacheDisk.status = builder.addString(diskInfo->status);
+			builder.disks.append(cacheDisk);
+		}
+		cacheGame.disks = CacheBuilder::range(builder.disks, first);
+
+		/* sample */
+		cacheGame.samples = builder.addStringList(gameInfo->samples);
+
+		/* chip */
+		first = builder.chips.size();
+		foreach (ChipInfo* chipInfo, gameInfo->chips)
+		{
+			CacheChip cacheChip;
+			CacheBuilder::clear(cacheChip);
+			cacheChip.name = builder.addString(chipInfo->name);
+			cacheChip.tag = builder.addString(chipInfo->tag);
+			cacheChip.type = builder.addString(chipInfo->type);
+			cacheChip.clock = chipInfo->clock;
+			builder.chips.append(cacheChip);
+		}
+		cacheGame.chips = CacheBuilder::range(builder.chips, first);
+
+		/* softwarelist */
+		first = builder.softwareLists.size();
+		foreach (SoftwareListInfo* softwarelist, gameInfo->softwarelists)
+		{
+			CacheSoftwareList cacheSoftwareList;
+			CacheBuilder::clear(cacheSoftwareList);
+			cacheSoftwareList.name = builder.addString(softwarelist->name);
+			cacheSoftwareList.status = builder.addString(softwarelist->status);
+			cacheSoftwareList.filter = builder.addString(softwarelist->filter);
+			builder.softwareLists.append(cacheSoftwareList);
+		}
+		cacheGame.softwareLists = CacheBuilder::range(builder.softwareLists, first);
+
+		/* display */
+		first = builder.displays.size();
+		foreach (DisplayInfo* displayInfo, gameInfo->displays)
+		{
+			CacheDisplay cacheDisplay;
+			CacheBuilder::clear(cacheDisplay);
+			cacheDisplay.type = builder.addString(displayInfo->type);
+			cacheDisplay.rotate = builder.addString(displayInfo->rotate);
+			cacheDisplay.flipx = displayInfo->flipx;
+			cacheDisplay.width = displayInfo->width;
+			cacheDisplay.height = displayInfo->height;
+			cacheDisplay.refresh = builder.addString(displayInfo->refresh);
+			cacheDisplay.htotal = displayInfo->htotal;
+			cacheDisplay.hbend = displayInfo->hbend;
+			cacheDisplay.hbstart = displayInfo->hbstart;
+			cacheDisplay.vtotal = displayInfo->vtotal;
+			cacheDisplay.vbend = displayInfo->vbend;
+			cacheDisplay.vbstart = displayInfo->vbstart;
+			builder.displays.append(cacheDisplay);
+		}
+		cacheGame.displays = CacheBuilder::range(builder.displays, first);
+
+		/* sound */
+		cacheGame.channels = gameInfo->channels;
+
+		/* input */
+		if (gameInfo->service)
+			cacheGame.flags |= CACHE_GAME_SERVICE;
+		if (gameInfo->tilt)
+			cacheGame.flags |= CACHE_GAME_TILT;
+		cacheGame.players = gameInfo->players;
+		cacheGame.buttons = gameInfo->buttons;
+		cacheGame.coins = gameInfo->coins;
+
+		first = builder.controls.size();
+		foreach (ControlInfo* controlInfo, gameInfo->controls)
+		{
+			CacheControl cacheControl;
+			CacheBuilder::clear(cacheControl);
+			cacheControl.type = builder.addString(controlInfo->type);
+			cacheControl.minimum = controlInfo->minimum;
+			cacheControl.maximum = controlInfo->maximum;
+			cacheControl.sensitivity = controlInfo->sensitivity;
+			cacheControl.keydelta = controlInfo->keydelta;
+			cacheControl.reverse = controlInfo->reverse;
+			builder.controls.append(cacheControl);
+		}
+		cacheGame.controls = CacheBuilder::range(builder.controls, first);
+
+		/* driver */
+		cacheGame.status = gameInfo->status;
+		cacheGame.emulation = gameInfo->emulation;
+		cacheGame.color = gameInfo->color;
+		cacheGame.sound = gameInfo->sound;
+		cacheGame.graphic = gameInfo->graphic;
+		cacheGame.cocktail = gameInfo->cocktail;
+		cacheGame.protection = gameInfo->protection;
+		cacheGame.savestate = gameInfo->savestate;
+		cacheGame.palettesize = gameInfo->palettesize;
+
+		/*ramoption */
+		first = builder.ramOptions.size();
+		foreach (quint32 ramOption, gameInfo->ramOptions)
+			builder.ramOptions.append(ramOption);
+		cacheGame.ramOptions = CacheBuilder::range(builder.ramOptions, first);
+		cacheGame.defaultRamOption = gameInfo->defaultRamOption;
+
+		/* device */
+		//only const dev in mountedPath, the others are taken from the snapshot
+		first = builder.devices.size();
+		QMapIterator<QString, DeviceInfo *> devIt(gameInfo->devices);
+		while (devIt.hasNext())
+		{
+			devIt.next();
+			DeviceInfo *deviceInfo = devIt.value();
+			CacheDevice cacheDevice;
+			CacheBuilder::clear(cacheDevice);
+			cacheDevice.instanceName = builder.addString(devIt.key());
+			cacheDevice.type = builder.addString(deviceInfo->type);
+			cacheDevice.tag = builder.addString(deviceInfo->tag);
+			cacheDevice.mandatory = deviceInfo->mandatory;
+			cacheDevice.extensionNames = builder.addStringList(deviceInfo->extensionNames);
+
+			if (!deviceInfo->isConst)
+				cacheDevice.mountedPath = builder.addString(snapshot.mountedPaths.value(deviceInfo));
+			builder.devices.append(cacheDevice);
+		}
+		cacheGame.devices = CacheBuilder::range(builder.devices, first);
+
+		builder.games.append(cacheGame);
+	}
+
+	CacheHeader header;
+	CacheBuilder::clear(header);
+	header.sig = qToBigEndian<quint32>(MAMEPLUS_SIG);
+	header.version = qToBigEndian<qint16>(S11N_VER);
+	header.byteOrder = 0x0102;
+	header.gameCount = builder.games.size();
+	header.mameVersion = builder.addString(snapshot.mameVersion);
+	header.defaultIni = builder.addString(snapshot.defaultIni);
+
+	QByteArray buf;
+	buf.append((const char *)&header, sizeof(CacheHeader));
+
+	appendSection(buf, &header, CACHE_GAMES, builder.games.constData(), builder.games.size());
+	appendSection(buf, &header, CACHE_BIOSSETS, builder.biosSets.constData(), builder.biosSets.size());
+	appendSection(buf, &header, CACHE_ROMS, builder.roms.constData(), builder.roms.size());
+	appendSection(buf, &header, CACHE_DISKS, builder.disks.constData(), builder.disks.size());
+	appendSection(buf, &header, CACHE_CHIPS, builder.chips.constData(), builder.chips.size());
+	appendSection(buf, &header, CACHE_SOFTWARELISTS, builder.softwareLists.constData(), builder.softwareLists.size());
+	appendSection(buf, &header, CACHE_DISPLAYS, builder.displays.constData(), builder.displays.size());
+	appendSection(buf, &header, CACHE_CONTROLS, builder.controls.constData(), builder.controls.size());
+	appendSection(buf, &header, CACHE_DEVICES, builder.devices.constData(), builder.devices.size());
+	appendSection(buf, &header, CACHE_STRINGREFS, builder.stringRefs.constData(), builder.stringRefs.size());
+	appendSection(buf, &header, CACHE_RAMOPTIONS, builder.ramOptions.constData(), builder.ramOptions.size());
+	appendSection(buf, &header, CACHE_BLOBS, builder.blobs.constData(), builder.blobs.size());
+	appendSection(buf, &header, CACHE_STRINGS, builder.strings.constData(), builder.strings.size());
+
+	//header is complete now that all sections are placed
+	memcpy(buf.data(), &header, sizeof(CacheHeader));
+
+	return buf;
+}
+
+CacheWriter::CacheWriter(QObject *parent) :
+	QThread(parent)
+{
+}
+
+CacheWriter::~CacheWriter()
+{
+	wait();
+}
+
+void CacheWriter::write(const QString &_fileName, const CacheSnapshot &_snapshot)
+{
+	//only one write at a time
+	wait();
+
+	fileName = _fileName;
+	snapshot = _snapshot;
+
+	start(LowPriority);
+}
+
+void CacheWriter::run()
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	QByteArray data = GameCache::encode(snapshot);
+	snapshot = CacheSnapshot();
+	qint64 encodeTime = timer.restart();
+
+	//QSaveFile writes to a temp file and renames it on commit
+	QSaveFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly) || 
+		file.write(data) != data.size() ||
+		!file.commit())
+	{
+		win->log(QString("failed to write %1: %2").arg(fileName).arg(file.errorString()));
+		return;
+	}
+
+	double mb = data.size() / 1048576.0;
+	qint64 elapsed = qMax(timer.elapsed(), (qint64)1);
+	win->log(QString("saved %1: %2 MB encoded in %3 ms, written in %4 ms, %5 MB/s")
+		.arg(QFileInfo(fileName).fileName())
+		.arg(mb, 0, 'f', 1)
+		.arg(encodeTime)
+		.arg(elapsed)
+		.arg(mb * 1000 / elapsed, 0, 'f', 1));
+}
+
+static void writeIconImage(QDataStream &out, const QImage &image)
+{
+	out << (quint16)image.width() << (quint16)image.height();
+	out.writeRawData((const char *)image.constBits(), image.byteCount());
+}
+
+static QImage readIconImage(QDataStream &in)
+{
+	quint16 width, height;
+	in >> width >> height;
+
+	//icons are small, anything else is garbage
+	if (in.status() != QDataStream::Ok || width > 256 || height > 256)
+	{
+		in.setStatus(QDataStream::ReadCorruptData);
+		return QImage();
+	}
+
+	QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+	if (in.readRawData((char *)image.bits(), image.byteCount()) != image.byteCount())
+		in.setStatus(QDataStream::ReadPastEnd);
+
+	return image;
+}
+
+bool IconPack::load(const QString &stamp, QHash<QString, GameIcon *> &icons)
+{
+	QFile file(CFG_PREFIX + "cache/icons.cache");
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+
+	QDataStream in(&file);
+
+	quint32 mamepSig;
+	qint16 packVersion;
+	QString packStamp;
+	quint8 littleEndian;
+	quint32 count;
+
+	in >> mamepSig;
+	in >> packVersion;
+	if (mamepSig != MAMEPLUS_SIG || packVersion != ICON_PACK_VER)
+		return false;
+
+	in.setVersion(QDataStream::Qt_4_6);
+	in >> packStamp;
+	in >> littleEndian;
+	in >> count;
+
+	if (in.status() != QDataStream::Ok || packStamp != stamp || 
+		littleEndian != (QSysInfo::ByteOrder == QSysInfo::LittleEndian))
+		return false;
+
+	for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++)
+	{
+		QString gameName;
+		in >> gameName;
+
+		GameIcon *icon = new GameIcon();
+		icon->image = readIconImage(in);
+		icon->image16 = readIconImage(in);
+		icons[gameName] = icon;
+	}
+
+	if (in.status() != QDataStream::Ok)
+	{
+		qDeleteAll(icons);
+		icons.clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool IconPack::save(const QString &stamp, const QHash<QString, GameIcon *> &icons)
+{
+	QDir().mkpath(CFG_PREFIX + "cache");
+	QSaveFile file(CFG_PREFIX + "cache/icons.cache");
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	QDataStream out(&file);
+	out << (quint32)MAMEPLUS_SIG;
+	out << (qint16)ICON_PACK_VER;
+	out.setVersion(QDataStream::Qt_4_6);
+	out << stamp;
+	out << (quint8)(QSysInfo::ByteOrder == QSysInfo::LittleEndian);
+	out << (quint32)icons.size();
+
+	QHashIterator<QString, GameIcon *> it(icons);
+	while (it.hasNext())
+	{
+		it.next();
+		out << it.key();
+		writeIconImage(out, it.value()->image);
+		writeIconImage(out, it.value()->image16);
+	}
+
+	return file.commit();
+}
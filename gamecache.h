@@ -0,0 +1,294 @@
+#ifndef _GAMECACHE_H_
+#define _GAMECACHE_H_
+
+#include <QtWidgets>
+
+class MameDat;
+class GameInfo;
+class DeviceInfo;
+class GameIcon;
+
+#define ICON_PACK_VER 1
+
+/*
+gamelist.cache layout, everything except sig and version is in native byte order:
+
+	CacheHeader
+	sections, each aligned to 8 bytes and referenced by CacheHeader::sections
+
+records are fixed-size and refer to strings, blobs and other records by CacheRef,
+strings are stored as UTF-16 in one table, identical strings are stored once.
+the GUI works on GameInfo objects, so the whole file is read into them at startup
+*/
+
+enum
+{
+	CACHE_GAMES = 0,
+	CACHE_BIOSSETS,
+	CACHE_ROMS,
+	CACHE_DISKS,
+	CACHE_CHIPS,
+	CACHE_SOFTWARELISTS,
+	CACHE_DISPLAYS,
+	CACHE_CONTROLS,
+	CACHE_DEVICES,
+	CACHE_STRINGREFS,
+	CACHE_RAMOPTIONS,
+	CACHE_BLOBS,
+	CACHE_STRINGS,
+	CACHE_SECTION_LAST
+};
+
+enum
+{
+	CACHE_GAME_EXTROM = 0x01,
+	CACHE_GAME_BIOS = 0x02,
+	CACHE_GAME_DEVICE = 0x04,
+	CACHE_GAME_MECHANICAL = 0x08,
+	CACHE_GAME_GAMBLE = 0x10,
+	CACHE_GAME_SERVICE = 0x20,
+	CACHE_GAME_TILT = 0x40
+};
+
+// offset and count of items, the unit depends on what is referenced
+struct CacheRef
+{
+	quint32 offset;
+	quint32 length;
+};
+
+struct CacheHeader
+{
+	quint32 sig;		//big endian, same as stream caches
+	qint16 version;		//big endian
+	quint16 byteOrder;
+	quint32 gameCount;
+	quint32 reserved;
+	CacheRef mameVersion;
+	CacheRef defaultIni;
+	CacheRef sections[CACHE_SECTION_LAST];	//offset in bytes, number of items
+};
+
+struct CacheGame
+{
+	CacheRef name;
+	CacheRef romof;
+	CacheRef description;
+	CacheRef year;
+	CacheRef manufacturer;
+	CacheRef cloneof;
+	CacheRef sourcefile;
+	CacheRef sampleof;
+	CacheRef extraInfo;
+
+	//first item and count in the corresponding sections
+	CacheRef biosSets;
+	CacheRef roms;
+	CacheRef disks;
+	CacheRef samples;
+	CacheRef chips;
+	CacheRef softwareLists;
+	CacheRef displays;
+	CacheRef controls;
+	CacheRef devices;
+	CacheRef ramOptions;
+
+	quint32 palettesize;
+	quint32 defaultRamOption;
+	qint8 available;
+	quint8 flags;
+	quint8 channels;
+	quint8 players;
+	quint8 buttons;
+	quint8 coins;
+	quint8 status;
+	quint8 emulation;
+	quint8 color;
+	quint8 sound;
+	quint8 graphic;
+	quint8 cocktail;
+	quint8 protection;
+	quint8 savestate;
+	quint8 reserved[2];
+};
+
+struct CacheBiosSet
+{
+	CacheRef name;
+	CacheRef description;
+	quint8 isDefault;
+	quint8 reserved[7];
+};
+
+struct CacheRom
+{
+	quint64 size;
+	quint32 crc;
+	quint32 reserved;
+	CacheRef name;
+	CacheRef status;
+	CacheRef bios;
+	CacheRef merge;
+	CacheRef region;
+};
+
+struct CacheDisk
+{
+	CacheRef sha1;
+	CacheRef name;
+	CacheRef merge;
+	CacheRef region;
+	CacheRef status;
+	quint8 index;
+	quint8 reserved[7];
+};
+
+struct CacheChip
+{
+	CacheRef name;
+	CacheRef tag;
+	CacheRef type;
+	quint32 clock;
+	quint32 reserved;
+};
+
+struct CacheSoftwareList
+{
+	CacheRef name;
+	CacheRef status;
+	CacheRef filter;
+};
+
+struct CacheDisplay
+{
+	CacheRef type;
+	CacheRef rotate;
+	CacheRef refresh;
+	quint16 width;
+	quint16 height;
+	quint16 htotal;
+	quint16 hbend;
+	quint16 hbstart;
+	quint16 vtotal;
+	quint16 vbend;
+	quint16 vbstart;
+	quint8 flipx;
+	quint8 reserved[7];
+};
+
+struct CacheControl
+{
+	CacheRef type;
+	quint16 minimum;
+	quint16 maximum;
+	quint16 sensitivity;
+	quint16 keydelta;
+	quint8 reverse;
+	quint8 reserved[7];
+};
+
+struct CacheDevice
+{
+	CacheRef instanceName;
+	CacheRef type;
+	CacheRef tag;
+	CacheRef mountedPath;
+	CacheRef extensionNames;
+	quint8 mandatory;
+	quint8 reserved[7];
+};
+
+// the fields of an ext rom, it can be deleted while its copy is encoded
+class CacheExtRom
+{
+public:
+	QString description;
+	QString romof;
+	QByteArray extraInfo;
+};
+
+/*
+what encode() reads from a dat, taken in the GUI thread so that the writer can encode it.
+games other than ext roms are referred to, the fields written for them do not change
+after loading except the ones copied here, and the dat outlives the writer
+*/
+class CacheSnapshot
+{
+public:
+	QString mameVersion;
+	QString defaultIni;
+	QList<QPair<QString, GameInfo *> > games;	//NULL for ext roms
+	QVector<qint8> availables;
+	QHash<int /*index in games*/, CacheExtRom> extRoms;
+	QHash<const DeviceInfo *, QString> mountedPaths;
+
+	CacheSnapshot();
+	CacheSnapshot(const MameDat *);
+	quint64 stamp() const;
+};
+
+// read only view of a mapped gamelist.cache
+class GameCache
+{
+public:
+	GameCache();
+	~GameCache();
+
+	// returns the s11n version of the file, 0 if it is not a valid cache
+	int open(const QString &);
+	void close();
+
+	// materialize the whole cache into the dat
+	int load(MameDat *);
+
+	// encode a dat snapshot in cache format
+	static QByteArray encode(const CacheSnapshot &);
+
+private:
+	QFile file;
+	const uchar *data;
+	qint64 size;
+	const CacheHeader *header;
+	const QChar *strings;
+	QHash<quint32, QString> *stringTable;
+
+	const CacheGame *game(int) const;
+	QString string(const CacheRef &) const;
+	QByteArray blob(const CacheRef &) const;
+	const void *itemData(int, const CacheRef &) const;
+
+	template <typename T>
+	const T *items(int section, const CacheRef &range) const
+	{
+		return (const T *)itemData(section, range);
+	}
+};
+
+// encodes and writes a cache in a background thread, the old file is replaced atomically
+class CacheWriter : public QThread
+{
+public:
+	CacheWriter(QObject *parent = 0);
+	~CacheWriter();
+	void write(const QString &, const CacheSnapshot &);
+
+protected:
+	void run();
+
+private:
+	QString fileName;
+	CacheSnapshot snapshot;
+};
+
+/*
+icons.cache holds the decoded icons of all games as raw premultiplied bitmaps in native
+byte order, so that no ICO has to be parsed again until the icon sources change
+*/
+class IconPack
+{
+public:
+	static bool load(const QString &stamp, QHash<QString, GameIcon *> &);
+	static bool save(const QString &stamp, const QHash<QString, GameIcon *> &);
+};
+
+#endif
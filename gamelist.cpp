@@ -1,5 +1,6 @@
 #include <QtConcurrent>
 #include "gamelist.h"
+#include "gamecache.h"
 #include "prototype.h"
 #include "utils.h"
 #include "processmanager.h"
@@ -68,6 +69,9 @@ enum
 	COL_LAST
 };
 
+//a rank for each column
+#define SORT_KEYS COL_LAST
+
 //from treeview.h
 enum
 {
@@ -123,10 +127,17 @@ enum {
 };
 
 UpdateSelectionThread::UpdateSelectionThread(QObject *parent) :
-	QThread(parent),
-	gameName(""),
-	abort(false)
+	QObject(parent),
+	generation(0),
+	pendingTasks(0)
 {
+	thumbnailStore = new ThumbnailStore(this);
+
+	docCache.setMaxCost(DOC_CACHE_SIZE);
+
+	//one background thread is enough to stay ahead of the cursor
+	prefetchPool.setMaxThreadCount(1);
+
 	QFile icoFile;
 
 	if (defIconDataGreen.isEmpty())
@@ -164,165 +175,435 @@ UpdateSelectionThread::UpdateSelectionThread(QObject *parent) :
 
 UpdateSelectionThread::~UpdateSelectionThread()
 {
-	abort = true;
-	wait();
+	//cancel all tasks
+	generation.fetchAndAddOrdered(1);
+	prefetchPool.clear();
+	pool.waitForDone();
+	prefetchPool.waitForDone();
 }
 
-void UpdateSelectionThread::update()
+// documents shown in the text docks
+static const struct
 {
-	QMutexLocker locker(&mutex);
+	const char *optName;
+	const char *fileName;
+	int type;
+	const char *title;
+}
+docInfoList[] =
+{
+	{ "history_file",  "history.dat",  DOCK_HISTORY,    "History" },
+	{ "mameinfo_file", "mameinfo.dat", DOCK_MAMEINFO,   "MAMEInfo" },
+	{ "mameinfo_file", "mameinfo.dat", DOCK_DRIVERINFO, "DriverInfo" },
+	{ "story_file",    "story.dat",    DOCK_STORY,      "Story" },
+	{ "command_file",  "command.dat",  DOCK_COMMAND,    "Command" },
+	{ NULL,            NULL,           0,               NULL }
+};
 
+// loads one dock for one selection in a pool thread
+class SelectionTask : public QRunnable
+{
+public:
+	SelectionTask(UpdateSelectionThread *_owner, const QSharedPointer<SelectionSource> &_source, int _type, int _token, bool _isPrefetch = false) :
+		owner(_owner),
+		source(_source),
+		type(_type),
+		token(_token),
+		isPrefetch(_isPrefetch)
+	{
+	}
+
+	void run()
+	{
+		if (isPrefetch)
+		{
+			QThread::currentThread()->setPriority(QThread::LowestPriority);
+			owner->prefetchDock(*source, type, token);
+			return;
+		}
+
+		owner->loadDock(*source, type, token);
+		owner->taskDone(token);
+	}
+
+private:
+	UpdateSelectionThread *owner;
+	QSharedPointer<SelectionSource> source;
+	int type;
+	int token;
+	bool isPrefetch;
+};
+
+// start a task for each visible dock, tasks of the previous selection are cancelled
+void UpdateSelectionThread::update()
+{
 	if (currentGame.isEmpty()/* || currentGame == gameName */)
 		return;
 
-	gameName = currentGame;
+	QMutexLocker locker(&mutex);
+
+	int token = generation.fetchAndAddOrdered(1) + 1;
+	//drop queued tasks of older selections, running ones see the new token
+	pool.clear();
+	prefetchPool.clear();
+	prefetchSources.clear();
+	visibleDocks.clear();
+
+	for (int snapType = DOCK_SNAP; snapType <= DOCK_PCB; snapType ++)
+	{
+		if (win->dockCtrls[snapType]->isVisible() && win->isDockTabVisible(win->dockCtrlNames[snapType]))
+		{
+			visibleDocks << snapType;
+
+			//tasks scale snaps to the current dock size
+			dockBounds[snapType] = ((Screenshot*)win->dockCtrls[snapType])->boundingSize();
+			dockAspects[snapType] = (snapType == DOCK_SNAP || snapType == DOCK_TITLE) && 
+				win->actionEnforceAspect->isChecked();
+		}
+	}
+
+	QTextBrowser *docCtrls[] =
+		{ win->tbHistory, win->tbMameinfo, win->tbDriverinfo, win->tbStory, win->tbCommand };
 
-	if (!isRunning())
+	for (int i = 0; docInfoList[i].optName != NULL; i++)
 	{
-		abort = false;
-		start(LowPriority);
+		if (docCtrls[i]->isVisible() && win->isDockTabVisible(docInfoList[i].title))
+			visibleDocks << docInfoList[i].type;
 	}
+
+	QSharedPointer<SelectionSource> source = captureSource(currentGame);
+
+	pendingTasks = visibleDocks.size();
+	foreach (int type, visibleDocks)
+		pool.start(new SelectionTask(this, source, type, token));
 }
 
-void UpdateSelectionThread::run()
+// warm the caches for games the cursor is likely to reach next
+void UpdateSelectionThread::prefetch(const QStringList &gameNames)
 {
-	// construct dockInfo
-	struct DockInfo
+	QList<QSharedPointer<SelectionSource> > sources;
+	foreach (QString gameName, gameNames)
+		sources << captureSource(gameName);
+
+	QMutexLocker locker(&mutex);
+
+	prefetchSources = sources;
+	if (pendingTasks == 0)
+		startPrefetch(generation.load());
+}
+
+// lineage of a game by cloneof, starting with the game itself
+static QStringList parentLineage(const QString &gameName)
+{
+	QStringList lineage;
+	QString name = gameName;
+
+	while (!name.isEmpty() && !lineage.contains(name))
 	{
-		QString optName;
-		QString fileName;
-		int type;
-		QString title;
-		QString *buffer;
-		bool isVisible;
-	};
+		lineage << name;
+		GameInfo *gameInfo = pMameDat->games.value(name);
+		name = gameInfo != NULL ? gameInfo->cloneof : QString();
+	}
+
+	return lineage;
+}
 
-	DockInfo _dockInfoList[] =
+// copy what the tasks of a game read, pool threads must not touch the dat or the options
+QSharedPointer<SelectionSource> UpdateSelectionThread::captureSource(const QString &gameName)
+{
+	QSharedPointer<SelectionSource> source(new SelectionSource());
+	source->gameName = gameName;
+	source->snapLineage = parentLineage(gameName);
+	source->docLineage = source->snapLineage;
+
+	GameInfo *gameInfo = pMameDat->games.value(gameName);
+	if (gameInfo != NULL)
 	{
-		{ "history_file",  "history.dat",  DOCK_HISTORY,    "History",    &historyText,    win->tbHistory->isVisible() },
-		{ "mameinfo_file", "mameinfo.dat", DOCK_MAMEINFO,   "MAMEInfo",   &mameinfoText,   win->tbMameinfo->isVisible() },
-		{ "mameinfo_file", "mameinfo.dat", DOCK_DRIVERINFO, "DriverInfo", &driverinfoText, win->tbDriverinfo->isVisible() },
-		{ "story_file",    "story.dat",    DOCK_STORY,      "Story",      &storyText,      win->tbStory->isVisible() },
-		{ "command_file",  "command.dat",  DOCK_COMMAND,    "Command",    &commandText,    win->tbCommand->isVisible() },
-		{ NULL,            NULL,           0,               NULL,         NULL,            false }
-	};
+		source->sourcefile = gameInfo->sourcefile;
+
+		//dats list ext roms under the console
+		if (gameInfo->isExtRom)
+			source->docLineage = parentLineage(gameInfo->romof);
+
+		QMap<QString, QPair<QString, QString> > romRegions;
+		foreach (RomInfo *romInfo, gameInfo->roms)
+			romRegions.insert(romInfo->region + romInfo->name, qMakePair(romInfo->region, romInfo->name));
 
-	//save a local copy
-	QString _gameName = gameName;
+		QMap<QString, QPair<QString, QString> > diskRegions;
+		foreach (DiskInfo *diskInfo, gameInfo->disks)
+			diskRegions.insert(diskInfo->region + diskInfo->name, qMakePair(diskInfo->region, diskInfo->name + ".chd"));
+
+		source->regions = romRegions.values() + diskRegions.values();
+	}
 
-	while (!abort)
+	GameInfo *rootInfo = pMameDat->games.value(source->snapLineage.value(source->snapLineage.size() - 1));
+	source->isMessSnap = isMESS || 
+		(rootInfo != NULL && (rootInfo->isExtRom || !rootInfo->devices.isEmpty()));
+
+	QStringList optNames;
+	for (int snapType = DOCK_SNAP; snapType <= DOCK_PCB; snapType ++)
+		optNames << validGuiSettings[snapType];
+	for (int i = 0; docInfoList[i].optName != NULL; i++)
+		optNames << docInfoList[i].optName;
+	optNames << "langpath";
+
+	foreach (QString optName, optNames)
 	{
-		//update snaps
-		for (int snapType = DOCK_SNAP; snapType <= DOCK_PCB; snapType ++)
-		{
-			if (_gameName != gameName)
-			{
-				abort = true;
-				break;
-			}
+		MameOption *mameOpt = mameOpts.value(optName);
+		if (mameOpt != NULL)
+			source->options[optName] = mameOpt->globalvalue;
+	}
 
+	//the pattern is taken as currently set
+	MameOption *snapNameOpt = mameOpts.value("snapname");
+	if (snapNameOpt != NULL)
+		source->options["snapname"] = snapNameOpt->currvalue;
 
-			if (!abort && win->dockCtrls[snapType]->isVisible() && win->isDockTabVisible(win->dockCtrlNames[snapType]))
-			{
-				pmSnapData[snapType] = getScreenshot(mameOpts[validGuiSettings[snapType]]->globalvalue, _gameName, snapType);
-				emit snapUpdated(snapType);
-			}
-		}
+	return source;
+}
 
-		QString path, localPath;
-		const DockInfo *dockInfoList = _dockInfoList;
+// bring thumbnail packs up to date with the artwork, built in the background
+void UpdateSelectionThread::updateThumbnails()
+{
+	QStringList gameNames;
+	foreach (QString gameName, pMameDat->games.keys())
+		if (!pMameDat->games[gameName]->isExtRom)
+			gameNames << gameName;
 
-		//update documents
-		for ( ; dockInfoList->optName != NULL; dockInfoList++)
-		{
-			if (_gameName != gameName)
-			{
-				abort = true;
-				break;
-			}
-			
-			// if (!abort && win->tbHistory->isVisible() && win->isDockTabVisible(dockInfoList->title))
-			if (!abort && dockInfoList->isVisible && win->isDockTabVisible(dockInfoList->title))
-			{
-				if (hasLanguage)
-					localPath = utils->getPath(mameOpts["langpath"]->globalvalue);
+	thumbnailStore->update(gameNames);
+}
 
-				dockInfoList->buffer->clear();
+void UpdateSelectionThread::clearCache()
+{
+	QMutexLocker locker(&mutex);
 
-				path = dockInfoList->fileName;
+	utils->imageCache.clear();
+	docCache.clear();
+}
 
-				if (!localPath.isEmpty())
-				{
-					localPath = localPath + language + "/" + path;
+// a task of the selection is done, prefetching starts after the last one
+void UpdateSelectionThread::taskDone(int token)
+{
+	QMutexLocker locker(&mutex);
 
-					*dockInfoList->buffer = getHistory(localPath, _gameName, dockInfoList->type + DOCK_LAST /*hack for local*/);
-					if (!dockInfoList->buffer->isEmpty())
-						dockInfoList->buffer->append("<hr>");
-				}
+	if (isCancelled(token) || --pendingTasks > 0)
+		return;
 
-				if (mameOpts.contains(dockInfoList->optName))
-					path = mameOpts[dockInfoList->optName]->globalvalue;
+	startPrefetch(token);
+}
 
-				//don't display the same dat twice
-				if (localPath != path)
-					dockInfoList->buffer->append(getHistory(path, _gameName, dockInfoList->type));
+// must be called with the mutex locked
+void UpdateSelectionThread::startPrefetch(int token)
+{
+	foreach (QSharedPointer<SelectionSource> source, prefetchSources)
+		foreach (int type, visibleDocks)
+			prefetchPool.start(new SelectionTask(this, source, type, token, true));
 
-				//special handling
-				switch (dockInfoList->type)
-				{
-				case DOCK_MAMEINFO:
-					convertMameInfo(mameinfoText, _gameName);
-					break;
+	prefetchSources.clear();
+}
 
-				case DOCK_COMMAND:
-					convertCommand(commandText);
-					break;
+bool UpdateSelectionThread::isCancelled(int token) const
+{
+	return token != generation.load();
+}
 
-				default:
-					break;
-				}
+void UpdateSelectionThread::snapImage(int snapType, QVector<QImage> &levels, QImage &fitted)
+{
+	QMutexLocker locker(&mutex);
+	levels = snapLevels[snapType];
+	fitted = snapFitted[snapType];
+}
 
+QString UpdateSelectionThread::docText(int docType)
+{
+	QMutexLocker locker(&mutex);
+	return docTexts[docType - DOCK_HISTORY];
+}
 
-				emit snapUpdated(dockInfoList->type);
-			}
-		}
+void UpdateSelectionThread::loadDock(const SelectionSource &source, int type, int token)
+{
+	if (isCancelled(token))
+		return;
+
+	QVector<QImage> levels;
+	QImage fitted;
+	QString text;
+	fetchDock(source, type, token, levels, text);
+
+	//scale to the dock from the nearest mip level
+	if (!levels.isEmpty())
+	{
+		mutex.lock();
+		QSize bounding = dockBounds[type];
+		bool forceAspect = dockAspects[type];
+		mutex.unlock();
+
+		fitted = Screenshot::scaleMipChain(levels, utils->getScaledSize(levels.first().size(), bounding, forceAspect));
+	}
 
-		if (abort)
+	{
+		QMutexLocker locker(&mutex);
+		//a newer selection owns the dock now
+		if (isCancelled(token))
+			return;
+
+		if (type <= DOCK_PCB)
 		{
-			_gameName = gameName;
-			abort = false;
+			snapLevels[type] = levels;
+			snapFitted[type] = fitted;
 		}
 		else
-			break;
+			docTexts[type - DOCK_HISTORY] = text;
 	}
+
+	emit snapUpdated(type);
 }
 
-QString UpdateSelectionThread::getHistory(const QString &fileName, const QString &gameName, int method)
+void UpdateSelectionThread::prefetchDock(const SelectionSource &source, int type, int token)
 {
-	QString buf = "";
+	QVector<QImage> levels;
+	QString text;
 
-	QString searchTag = gameName;
-	GameInfo *gameInfo = pMameDat->games[searchTag];
-	if (gameInfo->isExtRom)
+	//yield to the next selection
+	if (!isCancelled(token))
+		fetchDock(source, type, token, levels, text);
+}
+
+// get a dock from the cache or load it, results are cached unless cancelled halfway
+void UpdateSelectionThread::fetchDock(const SelectionSource &source, int type, int token, QVector<QImage> &levels, QString &text)
+{
+	//the smallest thumbnail that fills the dock serves it, originals serve larger docks
+	int thumbSize = 0;
+	if (type <= DOCK_PCB)
 	{
-		searchTag = gameInfo->romof;
-//		gameInfo = pMameDat->games[searchTag];
+		QMutexLocker locker(&mutex);
+		thumbSize = thumbnailStore->sizeFor(dockBounds[type]);
 	}
-	if (method == DOCK_DRIVERINFO)
-		searchTag = gameInfo->sourcefile;
 
-	QFileInfo fileInfo(fileName);
-	QStringList paths = utils->split2Str(fileInfo.absoluteFilePath(), "/", true);
+	QString key = QString("%1|%2").arg(type).arg(source.gameName);
+	if (thumbSize > 0)
+		key += QString("|%1").arg(thumbSize);
 
-	QHash<QString, MameFileInfo *> mameFileInfoList =
-		utils->iterateMameFile(paths.first(), "", paths.last(), MAMEFILE_READ);
+	//snaps are cached decoded
+	if (type <= DOCK_PCB && utils->imageCache.find(key, levels))
+		return;
 
-	if (mameFileInfoList.size() > 0)
 	{
-		QTextStream in(mameFileInfoList[mameFileInfoList.keys().first()]->data);
+		QMutexLocker locker(&mutex);
+		if (type > DOCK_PCB && docCache.contains(key))
+		{
+			text = *docCache.object(key);
+			return;
+		}
+	}
+
+	//update snaps, decode them here rather than in the GUI thread
+	if (type <= DOCK_PCB)
+	{
+		QImage image;
+
+		//same parent fallback as getScreenshot()
+		if (thumbSize > 0)
+		{
+			foreach (QString name, source.snapLineage)
+				if (thumbnailStore->find(type, name, thumbSize, image))
+					break;
+		}
+
+		if (image.isNull())
+		{
+			QByteArray data = getScreenshot(source, type, token);
+
+			//a newer selection does not wait for the decode, nothing is cached then
+			if (isCancelled(token))
+				return;
+
+			image.loadFromData(data);
+		}
+
+		if (isCancelled(token))
+			return;
+
+		if (!image.isNull())
+			levels = Screenshot::buildMipChain(image);
+		utils->imageCache.insert(key, levels);
+		return;
+	}
+
+	//update documents
+	text = loadDoc(source, type, token);
+
+	QMutexLocker locker(&mutex);
+	if (!isCancelled(token))
+		docCache.insert(key, new QString(text), qMax(text.size() * 2 / 1024, 1));
+}
+
+QString UpdateSelectionThread::loadDoc(const SelectionSource &source, int type, int token)
+{
+	int i;
+	for (i = 0; docInfoList[i].type != type; i++)
+		;
+
+	QString buf, path, localPath;
+
+	path = docInfoList[i].fileName;
+
+	if (hasLanguage)
+	{
+		localPath = utils->getPath(source.options.value("langpath")) + language + "/" + path;
+
+		buf = getHistory(localPath, source, type + DOCK_LAST /*hack for local*/, token);
+		if (!buf.isEmpty())
+			buf.append("<hr>");
+	}
+
+	if (source.options.contains(docInfoList[i].optName))
+		path = source.options.value(docInfoList[i].optName);
+
+	//don't display the same dat twice
+	if (localPath != path)
+		buf.append(getHistory(path, source, type, token));
+
+	//special handling
+	switch (type)
+	{
+	case DOCK_MAMEINFO:
+		convertMameInfo(buf, source);
+		break;
+
+	case DOCK_COMMAND:
+		convertCommand(buf);
+		break;
+
+	default:
+		break;
+	}
+
+	return buf;
+}
+
+QString UpdateSelectionThread::getHistory(const QString &fileName, const SelectionSource &source, int method, int token)
+{
+	QString buf = "";
+	QString searchTag;
+
+	//driverinfo is looked up by the source file, other dats by the game and then its parents
+	QStringList searchTags = source.docLineage;
+	if (method == DOCK_DRIVERINFO)
+		searchTags = QStringList(source.sourcefile);
+
+	for (int i = 0; i < searchTags.size() && buf.isEmpty() && !isCancelled(token); i++)
+	{
+		searchTag = searchTags[i];
+
+		//the dat index serves only the lines between $info=searchTag and the next entry
+		QByteArray entry;
+		if (!utils->datIndex.find(fileName, searchTag, entry))
+			continue;
+
+		QTextStream in(entry);
 		in.setCodec("UTF-8");
 
-		bool isFound, recData = false;
 		QString line;
 
 		do
@@ -332,63 +613,30 @@ QString UpdateSelectionThread::getHistory(const QString &fileName, const QString
 			{
 				if (line.startsWith("$"))
 				{
-					if (line.startsWith("$info="))
-					{
-						isFound = false;
-						line.remove(0, 6);	//remove $info=
-						QStringList tags = line.split(',');
-
-						foreach (QString tag, tags)
-						{
-							//found the entry, start recording
-							if (tag == searchTag)
-							{
-								recData = true;
-								isFound = true;
-								break;
-							}
-						}
-
-						// reach another entry, stop recording
-						if (!isFound && recData)
-						{
-							recData = false;
-							//finished
-							break;
-						}
-					}
-					else if (recData && line.startsWith("$<a href="))
+					if (line.startsWith("$<a href="))
 					{
 						line.remove(0, 1);	//remove $
 						line.replace("<a href=", QString("<a style=\"color:") + (isDarkBg ? "#00a0e9" : "#006d9f") + "\" href=");
 						buf += line;
 						buf += "<br>";
 					}
-//					else if (recData)
+//					else
 //						buf += "<br>";
 
 				}
-				else if (recData)
+				else if (!line.isNull())
 				{
 					buf += line;
 					buf += "<br>";
 				}
 			}
 		}
-		while (!line.isNull() && !abort);
-	}
-
-	utils->clearMameFileInfoList(mameFileInfoList);
-
-	buf = buf.trimmed();
+		while (!line.isNull() && !isCancelled(token));
 
-	if (buf.isEmpty() && pMameDat->games.contains(searchTag))
-	{
-		gameInfo = pMameDat->games[searchTag];
-		if (!gameInfo->cloneof.isEmpty())
-			buf = getHistory(fileName, gameInfo->cloneof, method);
+		buf = buf.trimmed();
 	}
-	else if (method == DOCK_HISTORY)
+
+	if (!buf.isEmpty() && method == DOCK_HISTORY)
 		buf.prepend(QString("<a style=\"color:") + (isDarkBg ? "#00a0e9" : "#006d9f") +
 			"\" href=\"http://maws.mameworld.info/maws/romset/" + searchTag + "\">View information at MAWS</a><br>");
 
@@ -406,53 +654,24 @@ void UpdateSelectionThread::convertHistory(QString &text, const QString &gameNam
 {
 }
 
-void UpdateSelectionThread::convertMameInfo(QString &text, const QString &gameName)
+void UpdateSelectionThread::convertMameInfo(QString &text, const SelectionSource &source)
 {
-	GameInfo *gameInfo = pMameDat->games[gameName];
-	RomInfo *romInfo;
-	DiskInfo *diskInfo;
 	QString buf = "";
 
-	if (gameInfo->roms.isEmpty() && gameInfo->disks.isEmpty())
+	if (source.regions.isEmpty())
 		return;
 
 	buf.append("Rom Region:");
 	buf.append("<table>");
 
-	QMap<QString, quint32> romInfos;
-	foreach (quint32 crc, gameInfo->roms.keys())
-	{
-		romInfo = gameInfo->roms.value(crc);
-		romInfos.insert(romInfo->region + romInfo->name, crc);
-	}
-
-	foreach (quint32 crc, romInfos)
+	//roms, then disks, each sorted by region
+	for (int i = 0; i < source.regions.size(); i++)
 	{
 		buf.append("<tr>");
 
-		romInfo = gameInfo->roms.value(crc);
-		buf.append("<td>" + romInfo->region + "</td>");
+		buf.append("<td>" + source.regions[i].first + "</td>");
 		buf.append("<td> </td>");
-		buf.append("<td>" + romInfo->name + "</td>");
-
-		buf.append("</tr>");
-	}
-
-	QMap<QString, QString> diskInfos;
-	foreach (QString sha1, gameInfo->disks.keys())
-	{
-		diskInfo = gameInfo->disks.value(sha1);
-		diskInfos.insert(diskInfo->region + diskInfo->name, sha1);
-	}
-
-	foreach (QString sha1, diskInfos)
-	{
-		diskInfo = gameInfo->disks.value(sha1);
-		buf.append("<tr>");
-
-		buf.append("<td>" + diskInfo->region + "</td>");
-		buf.append("<td> </td>");
-		buf.append("<td>" + diskInfo->name + ".chd</td>");
+		buf.append("<td>" + source.regions[i].second + "</td>");
 
 		buf.append("</tr>");
 	}
@@ -510,17 +729,15 @@ void UpdateSelectionThread::convertCommand(QString &text)
 	const CmdTable *cmdTable = _cmdTable;
 
 	/* loop over entries until we hit a NULL name */
-	for ( ; !abort && cmdTable->repl != NULL; cmdTable++)
+	for ( ; cmdTable->repl != NULL; cmdTable++)
 	{
 		text.replace(cmdTable->regex, cmdTable->repl);
 	}
 }
 
-QByteArray UpdateSelectionThread::getScreenshot(const QString &_dirPaths, const QString &gameName, int snapType)
+// name of the built-in archive and folder of a snap type
+QString UpdateSelectionThread::snapArchiveName(int snapType)
 {
-	QByteArray snapdata = QByteArray();
-
-	// prepare built-in names
 	QString zipName;
 	switch (snapType)
 	{
@@ -547,13 +764,22 @@ QByteArray UpdateSelectionThread::getScreenshot(const QString &_dirPaths, const
 		break;
 	}
 
+	return zipName;
+}
+
+// read the own image of a game, without falling back to its parent, snapName is the snapname pattern
+QByteArray UpdateSelectionThread::readSnap(const QString &_dirPaths, const QString &gameName, int snapType, const QString &snapName)
+{
+	QByteArray snapdata = QByteArray();
+
+	QString zipName = snapArchiveName(snapType);
 	zipName = zipName.append(";.");
 	QString dirPaths = _dirPaths;
 	QString fileNameFilters = gameName + PNG_EXT;
 	// try to load from patterns
-	if (snapType == DOCK_SNAP && mameOpts.contains("snapname"))
+	if (snapType == DOCK_SNAP && !snapName.isEmpty())
 	{
-		QString pattern = mameOpts["snapname"]->currvalue;
+		QString pattern = snapName;
 
 		pattern.replace("%g", gameName);
 		pattern.replace("%i", "0000");
@@ -577,28 +803,35 @@ QByteArray UpdateSelectionThread::getScreenshot(const QString &_dirPaths, const
 
 	utils->clearMameFileInfoList(mameFileInfoList);
 
-	if (!snapdata.isNull())
-		return snapdata;
+	return snapdata;
+}
 
-	// recursively load parent image
-	GameInfo *gameInfo = pMameDat->games[gameName];
-		if (!gameInfo->cloneof.isEmpty())
-		snapdata = getScreenshot(_dirPaths, gameInfo->cloneof, snapType);
+QByteArray UpdateSelectionThread::getScreenshot(const SelectionSource &source, int snapType, int token)
+{
+	QString dirPaths = source.options.value(validGuiSettings[snapType]);
 
-	// fallback to default image, first getScreenshot() can't reach here
-	if (snapdata.isNull())
-		snapdata = (isMESS || gameInfo->isExtRom || !gameInfo->devices.isEmpty()) ?
-			defMessSnapData : defMameSnapData;
+	//the own image or the nearest one of a parent
+	foreach (QString gameName, source.snapLineage)
+	{
+		if (isCancelled(token))
+			return QByteArray();
 
-	return snapdata;
+		QByteArray snapdata = readSnap(dirPaths, gameName, snapType, source.options.value("snapname"));
+		if (!snapdata.isNull())
+			return snapdata;
+	}
+
+	// fallback to default image
+	return source.isMessSnap ? defMessSnapData : defMameSnapData;
 }
 
 
 /* a copy of Qt example itemviews/simpletreemodel */
-TreeItem::TreeItem(const QList<QVariant> &data, TreeItem *parent)
+TreeItem::TreeItem(int _id, TreeItem *parent)
 {
 	parentItem = parent;
-	itemData = data;
+	id = _id;
+	rowNumber = 0;
 }
 
 TreeItem::~TreeItem()
@@ -608,9 +841,18 @@ TreeItem::~TreeItem()
 
 void TreeItem::appendChild(TreeItem *item)
 {
+	item->rowNumber = childItems.size();
 	childItems.append(item);
 }
 
+void TreeItem::removeChild(int row)
+{
+	delete childItems.takeAt(row);
+
+	for (int i = row; i < childItems.size(); i++)
+		childItems[i]->rowNumber = i;
+}
+
 TreeItem *TreeItem::child(int row)
 {
 	return childItems.value(row);
@@ -621,34 +863,135 @@ int TreeItem::childCount() const
 	return childItems.size();
 }
 
-int TreeItem::columnCount() const
+int TreeItem::row() const
 {
-	return itemData.size();
+	return rowNumber;
 }
 
-QVariant TreeItem::data(int column) const
+TreeItem *TreeItem::parent()
 {
-	return itemData.value(column);
+	return parentItem;
 }
 
-int TreeItem::row() const
+int TreeItem::rowId() const
 {
-	if (parentItem)
-		return parentItem->childItems.indexOf(const_cast<TreeItem*>(this));
+	return id;
+}
 
-	return 0;
+void TreeItem::setRowId(int _id)
+{
+	id = _id;
 }
 
-TreeItem *TreeItem::parent()
+// add a row and return its id
+int GameTable::append(const QString &gameName, GameInfo *gameInfo)
 {
-	return parentItem;
+	int id = gameInfos.size();
+
+	gameInfos.append(gameInfo);
+	availables.append(gameInfo->available);
+	ids.insert(gameInfo, id);
+	names.insert(gameName, id);
+
+	//the 'ROMs' column is kept in availables
+	stringIds.resize((id + 1) * COL_LAST);
+	quint32 *row = stringIds.data() + id * COL_LAST;
+	row[COL_DESC] = intern(gameInfo->description);
+	row[COL_NAME] = intern(gameName);
+	row[COL_MFTR] = intern(gameInfo->manufacturer);
+	row[COL_SRC] = intern(gameInfo->sourcefile);
+	row[COL_YEAR] = intern(gameInfo->year);
+	row[COL_CLONEOF] = intern(gameInfo->cloneof);
+
+	return id;
+}
+
+// the id is not reused, its game is gone
+void GameTable::remove(int id)
+{
+	ids.remove(gameInfos[id]);
+	names.remove(string(id, COL_NAME));
+	gameInfos[id] = NULL;
+}
+
+int GameTable::size() const
+{
+	return gameInfos.size();
+}
+
+int GameTable::indexOf(const GameInfo *gameInfo) const
+{
+	return ids.value(gameInfo, -1);
+}
+
+GameInfo *GameTable::gameInfo(int id) const
+{
+	return gameInfos[id];
+}
+
+// the table holds the games the model was built from, look them up here instead of pMameDat
+GameInfo *GameTable::gameInfo(const QString &gameName) const
+{
+	int id = names.value(gameName, -1);
+	return id < 0 ? NULL : gameInfos[id];
+}
+
+const QString &GameTable::string(int id, int col) const
+{
+	return strings.at(stringIds[id * COL_LAST + col]);
+}
+
+qint8 GameTable::available(int id) const
+{
+	return availables[id];
+}
+
+void GameTable::setAvailable(int id, qint8 available)
+{
+	availables[id] = available;
+}
+
+quint32 GameTable::intern(const QString &str)
+{
+	QHash<QString, quint32>::const_iterator it = stringIndex.constFind(str);
+	if (it != stringIndex.constEnd())
+		return it.value();
+
+	quint32 stringId = strings.size();
+	strings.append(str);
+	stringIndex.insert(str, stringId);
+	return stringId;
 }
 
-TreeModel::TreeModel(QObject *parent)
-: QAbstractItemModel(parent)
+// orders rows by their collation keys, then by game name
+class SortKeyLessThan
 {
-	QList<QVariant> rootData;
+public:
+	SortKeyLessThan(const QList<QCollatorSortKey> &_keys, const QVector<QString> &_names) :
+	keys(_keys),
+	names(_names)
+	{
+	}
+
+	bool operator()(int a, int b) const
+	{
+		int result = keys[a].compare(keys[b]);
+		if (result != 0)
+			return result < 0;
+		return names[a] < names[b];
+	}
+
+private:
+	const QList<QCollatorSortKey> &keys;
+	const QVector<QString> &names;
+};
 
+TreeModel::TreeModel(const QList<QPair<QString, GameInfo *> > &games, bool grouped, QObject *parent)
+: QAbstractItemModel(parent),
+isGrouped(grouped),
+sortKeysDirty(true),
+rankedRows(0)
+{
 	columnList = (QStringList()
 		<< QT_TR_NOOP("Description")
 		<< QT_TR_NOOP("Name")
@@ -659,14 +1002,34 @@ TreeModel::TreeModel(QObject *parent)
 		<< QT_TR_NOOP("Clone of"));
 
 	foreach (QString header, columnList)
-		rootData << tr(qPrintable(header));
+		headers << tr(qPrintable(header));
 
-	rootItem = new TreeItem(rootData);
+	rootItem = new TreeItem();
 
-	foreach (QString gameName, pMameDat->games.keys())
+	//the model may be built in a background thread from a copy of the game list,
+	//games are pointed at its items in attachItems()
+	for (int i = 0; i < games.size(); i++)
+		gameTable.append(games[i].first, games[i].second);
+
+	for (int id = 0; id < gameTable.size(); id++)
 	{
-		setupModelData(rootItem, gameName);
+		GameInfo *gameInfo = gameTable.gameInfo(id);
+
+		//grouped clones become children of their parent
+		if (isGrouped && !gameInfo->cloneof.isEmpty())
+		{
+			int parentId = gameTable.indexOf(gameTable.gameInfo(gameInfo->cloneof));
+			if (parentId >= 0 && gameTable.gameInfo(parentId)->cloneof.isEmpty())
+			{
+				cloneIds[parentId].append(id);
+				continue;
+			}
+		}
+
+		rootItem->appendChild(new TreeItem(id, rootItem));
 	}
+
+	folderFilter.build(gameTable);
 }
 
 TreeModel::~TreeModel()
@@ -717,9 +1080,63 @@ QModelIndex TreeModel::parent(const QModelIndex &index) const
 	return createIndex(parentItem->row(), 0, parentItem);
 }
 
-QVariant TreeModel::displayData(GameInfo *gameInfo, int col) const
+bool TreeModel::hasChildren(const QModelIndex &parent) const
 {
-	TreeItem *item = gameInfo->pModItem;
+	if (!parent.isValid())
+		return rootItem->childCount() > 0;
+
+	if (parent.column() > 0)
+		return false;
+
+	TreeItem *item = getItem(parent);
+	return item->childCount() > 0 || cloneIds.contains(item->rowId());
+}
+
+bool TreeModel::canFetchMore(const QModelIndex &parent) const
+{
+	if (!parent.isValid() || parent.column() > 0)
+		return false;
+
+	TreeItem *item = getItem(parent);
+	return item->childCount() == 0 && cloneIds.contains(item->rowId());
+}
+
+// create the rows of the clones of a parent
+void TreeModel::fetchMore(const QModelIndex &parent)
+{
+	if (!canFetchMore(parent))
+		return;
+
+	TreeItem *item = getItem(parent);
+	const QVector<int> &ids = cloneIds[item->rowId()];
+
+	beginInsertRows(parent, 0, ids.size() - 1);
+	foreach (int id, ids)
+		setupModelData(item, id);
+	endInsertRows();
+}
+
+// index of a game, a clone is fetched if its parent is not expanded yet
+QModelIndex TreeModel::gameIndex(GameInfo *gameInfo, int column)
+{
+	if (gameInfo->pModItem == NULL && !gameInfo->cloneof.isEmpty())
+	{
+		GameInfo *gameInfo2 = pMameDat->games.value(gameInfo->cloneof);
+		if (gameInfo2 != NULL && gameInfo2->pModItem != NULL)
+			fetchMore(index(0, gameInfo2->pModItem));
+	}
+
+	return index(column, gameInfo->pModItem);
+}
+
+QVector<int> TreeModel::cloneRowIds(int id) const
+{
+	return cloneIds.value(id);
+}
+
+QVariant TreeModel::displayData(int id, int col) const
+{
+	GameInfo *gameInfo = gameTable.gameInfo(id);
 
 	switch (col)
 	{
@@ -745,7 +1162,7 @@ QVariant TreeModel::displayData(GameInfo *gameInfo, int col) const
 
 	//convert 'ROMs' column
 	case COL_ROM:
-		switch (item->data(COL_ROM).toInt())
+		switch (gameTable.available(id))
 		{
 		case -1:
 			return "";
@@ -756,9 +1173,10 @@ QVariant TreeModel::displayData(GameInfo *gameInfo, int col) const
 		case 1:
 			return tr("Yes");
 		}
+		return (int)gameTable.available(id);
 	}
 
-	return item->data(col);
+	return gameTable.string(id, col);
 }
 
 //mandatory
@@ -767,9 +1185,8 @@ QVariant TreeModel::data(const QModelIndex &index, int role) const
 	if (!index.isValid())
 		return QVariant();
 
-	TreeItem *item = getItem(index);
-	const QString gameName = item->data(COL_NAME).toString();
-	GameInfo *gameInfo = pMameDat->games[gameName];
+	const int id = getItem(index)->rowId();
+	GameInfo *gameInfo = gameTable.gameInfo(id);
 	int col = index.column();
 
 	switch (role)
@@ -786,43 +1203,14 @@ QVariant TreeModel::data(const QModelIndex &index, int role) const
 	case Qt::UserRole + FOLDER_CONSOLE:
 		return gameInfo->isExtRom ? true : false;
 
-	case Qt::UserRole + SORT_STR:
-	{
-//		[parentsortkey]_[parentname]_[0/9][sortkey]
-
-		//fixme: move to static
-		const bool sortOrder = win->tvGameList->header()->sortIndicatorOrder() == Qt::AscendingOrder;
-
-		QString sortKey = displayData(gameInfo, col).toString();
-		QString parentSortKey = sortKey;
-		QString sortMagic;
-		QString parent = gameName;
-
-		if (gameList->listMode != "Grouped")
-			return sortKey;
-
-		if (!gameInfo->cloneof.isEmpty())
-		{
-			parent = gameInfo->cloneof;
-			GameInfo *gameInfo2 = pMameDat->games[parent];
-			parentSortKey = displayData(gameInfo2, col).toString();
-			//always keep parent on top
-			sortMagic = sortOrder ? "_9" : "_0";
-		}
-		else
-			sortMagic = sortOrder ? "_0" : "_9";
-
-		return parentSortKey + "_" + parent + sortMagic + sortKey;
-	}
-
 	//convert 'Name' column for ext roms
 	case Qt::UserRole:
 		if (col == COL_NAME && gameInfo->isExtRom)
-			return item->data(col);
+			return gameTable.string(id, col);
 		break;
 
 	case Qt::DisplayRole:
-		return displayData(gameInfo, col);
+		return displayData(id, col);
 
 	}
 
@@ -832,7 +1220,7 @@ QVariant TreeModel::data(const QModelIndex &index, int role) const
 QVariant TreeModel::headerData(int section, Qt::Orientation orientation, int role) const
 {
 	if (orientation == Qt::Horizontal && role == Qt::DisplayRole)
-		return rootItem->data(section);
+		return headers.value(section);
 
 	return QVariant();
 }
@@ -853,12 +1241,9 @@ int TreeModel::rowCount(const QModelIndex &parent) const
 }
 
 //mandatory
-int TreeModel::columnCount(const QModelIndex &parent) const
+int TreeModel::columnCount(const QModelIndex &/*parent*/) const
 {
-	if (parent.isValid())
-		return static_cast<TreeItem*>(parent.internalPointer())->columnCount();
-	else
-		return rootItem->columnCount();
+	return COL_LAST;
 }
 
 void TreeModel::updateRow(const QModelIndex &index)
@@ -869,6 +1254,201 @@ void TreeModel::updateRow(const QModelIndex &index)
 	emit dataChanged(i, j);
 }
 
+// sync the audit results of games to their rows, only changed rows are signaled, in contiguous ranges
+void TreeModel::updateGameRows(const QList<GameInfo *> &gameInfos)
+{
+	QMap<TreeItem * /*parent*/, QList<int> /*rows*/> changedRows;
+
+	foreach (GameInfo *gameInfo, gameInfos)
+	{
+		const int id = gameTable.indexOf(gameInfo);
+		if (id < 0 || gameTable.available(id) == gameInfo->available)
+			continue;
+
+		gameTable.setAvailable(id, gameInfo->available);
+		folderFilter.setAvailable(id, gameInfo->available == GAME_COMPLETE);
+
+		//the rank of the audit result is known, no need to rank all rows again
+		if (!sortKeysDirty && id < rankedRows && gameInfo->available >= -1 && gameInfo->available <= 2)
+			sortRanks[id * SORT_KEYS + COL_ROM] = romSortRanks[gameInfo->available + 1];
+		else
+			invalidateSortKeys();
+
+		//clones not fetched yet are filtered along with their parent
+		TreeItem *item = gameInfo->pModItem;
+		if (item == NULL && !gameInfo->cloneof.isEmpty())
+		{
+			GameInfo *parentInfo = pMameDat->games.value(gameInfo->cloneof);
+			if (parentInfo != NULL)
+				item = parentInfo->pModItem;
+		}
+
+		if (item != NULL)
+			changedRows[item->parent()] << item->row();
+	}
+
+	foreach (TreeItem *parentItem, changedRows.keys())
+	{
+		QList<int> rows = changedRows[parentItem];
+		qSort(rows);
+
+		for (int i = 0; i < rows.size(); )
+		{
+			int j = i;
+			while (j + 1 < rows.size() && rows[j + 1] <= rows[j] + 1)
+				j++;
+
+			emit dataChanged(createIndex(rows[i], 0, parentItem->child(rows[i])),
+				createIndex(rows[j], columnCount() - 1, parentItem->child(rows[j])));
+			i = j + 1;
+		}
+	}
+}
+
+// append rows in one go, they are ranked with the others before the next sort
+void TreeModel::insertGameRows(const QStringList &gameNames)
+{
+	if (gameNames.isEmpty())
+		return;
+
+	int row = rootItem->childCount();
+
+	invalidateSortKeys();
+	beginInsertRows(QModelIndex(), row, row + gameNames.size() - 1);
+	foreach (QString gameName, gameNames)
+		setupModelData(rootItem, gameTable.append(gameName, pMameDat->games.value(gameName)));
+	endInsertRows();
+}
+
+void TreeModel::removeGameRow(GameInfo *gameInfo)
+{
+	TreeItem *item = gameInfo->pModItem;
+	if (item == NULL)
+		return;
+
+	TreeItem *parentItem = item->parent();
+	int row = item->row();
+
+	beginRemoveRows(parentItem == rootItem ? QModelIndex() : index(0, parentItem), row, row);
+	gameTable.remove(item->rowId());
+	parentItem->removeChild(row);
+	gameInfo->pModItem = NULL;
+	endRemoveRows();
+}
+
+void TreeModel::buildSearchIndex()
+{
+	searchIndex.build(gameTable);
+}
+
+// compute everything the first filtering and sorting need, safe in a background thread
+void TreeModel::buildIndexes()
+{
+	buildSearchIndex();
+	buildSortKeys();
+}
+
+// items of the previous model are gone, point the games at this one, must be called in the GUI thread
+void TreeModel::attachItems()
+{
+	foreach (GameInfo *gameInfo, pMameDat->games)
+		gameInfo->pModItem = NULL;
+
+	for (int row = 0; row < rootItem->childCount(); row++)
+	{
+		TreeItem *item = rootItem->child(row);
+		gameTable.gameInfo(item->rowId())->pModItem = item;
+	}
+}
+
+// the displayed strings have changed, rank the rows again before the next sort
+void TreeModel::invalidateSortKeys()
+{
+	sortKeysDirty = true;
+}
+
+// rank every row by the collation key of each column, sorting then only compares integers
+void TreeModel::buildSortKeys() const
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	//clones that are not fetched yet are ranked as well
+	QVector<int> ids;
+	for (int id = 0; id < gameTable.size(); id++)
+		if (gameTable.gameInfo(id) != NULL)
+			ids.append(id);
+
+	int count = ids.size();
+	rankedRows = gameTable.size();
+	sortRanks.fill(0, rankedRows * SORT_KEYS);
+
+	QCollator collator;
+	QList<QCollatorSortKey> keys;
+	QVector<int> order(count);
+	QVector<QString> names(count);
+
+	for (int row = 0; row < count; row++)
+		names[row] = gameTable.string(ids[row], COL_NAME);
+
+	//the audit result changes while the list is shown, rank all its values
+	keys << collator.sortKey("") << collator.sortKey(tr("No")) << collator.sortKey(tr("Yes")) << collator.sortKey("2");
+	for (int i = 0; i < 4; i++)
+	{
+		romSortRanks[i] = 0;
+		for (int j = 0; j < 4; j++)
+			if (keys[j].compare(keys[i]) < 0)
+				romSortRanks[i]++;
+	}
+
+	for (int k = 0; k < SORT_KEYS; k++)
+	{
+		if (k == COL_ROM)
+		{
+			for (int row = 0; row < count; row++)
+			{
+				int available = gameTable.available(ids[row]);
+				if (available >= -1 && available <= 2)
+					sortRanks[ids[row] * SORT_KEYS + k] = romSortRanks[available + 1];
+			}
+			continue;
+		}
+
+		keys.clear();
+		for (int row = 0; row < count; row++)
+		{
+			keys << collator.sortKey(displayData(ids[row], k).toString());
+			order[row] = row;
+		}
+
+		qSort(order.begin(), order.end(), SortKeyLessThan(keys, names));
+
+		//game names are unique, so every row gets its own rank
+		for (int i = 0; i < count; i++)
+			sortRanks[ids[order[i]] * SORT_KEYS + k] = i;
+	}
+
+	sortKeysDirty = false;
+	win->log(QString("ranked %1 rows for sorting in %2 ms.").arg(count).arg(timer.elapsed()));
+}
+
+// clones are children of their parent, so every level is sorted by its own ranks
+bool TreeModel::sortLessThan(const QModelIndex &left, const QModelIndex &right) const
+{
+	if (sortKeysDirty)
+		buildSortKeys();
+
+	int col = left.column();
+	int l = getItem(left)->rowId();
+	int r = getItem(right)->rowId();
+
+	//audit results share a rank per value, break ties by the game name
+	if (sortRanks[l * SORT_KEYS + col] == sortRanks[r * SORT_KEYS + col])
+		return sortRanks[l * SORT_KEYS + COL_NAME] < sortRanks[r * SORT_KEYS + COL_NAME];
+
+	return sortRanks[l * SORT_KEYS + col] < sortRanks[r * SORT_KEYS + col];
+}
+
 TreeItem * TreeModel::getItem(const QModelIndex &index) const
 {
 	if (index.isValid())
@@ -880,26 +1460,14 @@ TreeItem * TreeModel::getItem(const QModelIndex &index) const
 	return rootItem;
 }
 
-TreeItem * TreeModel::setupModelData(TreeItem *parent, QString gameName)
+TreeItem * TreeModel::setupModelData(TreeItem *parent, int id)
 {
-	GameInfo *gameInfo = pMameDat->games[gameName];
-
-	if (gameName.trimmed() == "")
-		win->log("ERR2");
-
-	QList<QVariant> columnData;
-	columnData << gameInfo->description;
-	columnData << gameName;
-	columnData << gameInfo->available;
-	columnData << gameInfo->manufacturer;
-	columnData << gameInfo->sourcefile;
-	columnData << gameInfo->year;
-	columnData << gameInfo->cloneof;
+	GameInfo *gameInfo = gameTable.gameInfo(id);
 
 	// Append a new item to the current parent's list of children
 //	if (gameInfo->pModItem)
 //		delete gameInfo->pModItem;
-	gameInfo->pModItem = new TreeItem(columnData, parent);
+	gameInfo->pModItem = new TreeItem(id, parent);
 	parent->appendChild(gameInfo->pModItem);
 	return gameInfo->pModItem;
 }
@@ -942,42 +1510,114 @@ void GameListTreeView::paintEvent(QPaintEvent *e)
 		painter.drawPixmap(_decoRect, gameList->pmDeco);
 }
 
-QModelIndex GameListTreeView::moveCursor(QAbstractItemView::CursorAction cursorAction, Qt::KeyboardModifiers modifiers)
-{
-	QModelIndex index = QTreeView::moveCursor(cursorAction, modifiers);
-	gameList->centerGameSelection(index);
-	return index;
+QModelIndex GameListTreeView::moveCursor(QAbstractItemView::CursorAction cursorAction, Qt::KeyboardModifiers modifiers)
+{
+	QModelIndex index = QTreeView::moveCursor(cursorAction, modifiers);
+	gameList->centerGameSelection(index);
+	return index;
+}
+
+//Mac: start game with Return/Enter
+void GameListTreeView::keyPressEvent(QKeyEvent *event)
+{
+	switch (event->key())
+	{
+#ifdef Q_WS_MAC
+	case Qt::Key_Enter:
+	case Qt::Key_Return:
+		// ### we can't open the editor on enter, becuse
+		// some widgets will forward the enter event back
+		// to the viewport, starting an endless loop
+		if (state() != EditingState || hasFocus())
+		{
+			if (currentIndex().isValid())
+				emit triggered(currentIndex());
+			event->ignore();
+		}
+		break;
+#endif
+	default:
+		QTreeView::keyPressEvent(event);
+		break;
+	}
+}
+
+
+GameListDelegate::GameListDelegate(QObject *parent) :
+QItemDelegate(parent)
+{
+	if (QPixmapCache::cacheLimit() < ICON_CACHE_SIZE)
+		QPixmapCache::setCacheLimit(ICON_CACHE_SIZE);
+}
+
+// decode the icon of a game once per size, 0 is the original size
+QPixmap GameListDelegate::getIcon(const GameInfo *gameInfo, const QString &gameName, int size, bool isUnavailable) const
+{
+	QString key;
+
+	if (gameInfo->icon == NULL)
+	{
+		if (gameInfo->isExtRom || gameInfo->status == 1)
+			key = "ico_green";
+		else if (gameInfo->status == 2)
+			key = "ico_yellow";
+		else
+			key = "ico_red";
+	}
+	else
+		//icons are shared by clones and replaced when reloaded
+		key = QString("ico_%1").arg((quintptr)gameInfo->icon, 0, 16);
+
+	key += QString("_%1%2").arg(size).arg(isUnavailable ? "_na" : "");
+
+	QPixmap pm;
+	if (QPixmapCache::find(key, &pm))
+		return pm;
+
+	if (isUnavailable)
+	{
+		pm = getIcon(gameInfo, gameName, size, false);
+
+		// paint the unavailable icon on top of original icon
+		QPainter p;
+		p.begin(&pm);
+		p.drawPixmap(8, 8, 8, 8, getResource(":/res/status-na.png"));
+		p.end();
+	}
+	else if (size == ICON_SIZE_SMALL && gameInfo->icon != NULL)
+		pm = QPixmap::fromImage(gameInfo->icon->image16);
+	else if (size > 0)
+		pm = getIcon(gameInfo, gameName, 0, false).scaled(QSize(size, size), Qt::KeepAspectRatio, Qt::SmoothTransformation);
+	else if (gameInfo->icon == NULL)
+	{
+		if (gameInfo->isExtRom || gameInfo->status == 1)
+			pm.loadFromData(defIconDataGreen);
+		else if (gameInfo->status == 2)
+			pm.loadFromData(defIconDataYellow);
+		else
+			pm.loadFromData(defIconDataRed);
+
+		if (pm.isNull())
+			win->updateLog("icon error 2: cannot load");
+	}
+	else
+		pm = QPixmap::fromImage(gameInfo->icon->image);
+
+	QPixmapCache::insert(key, pm);
+	return pm;
 }
 
-//Mac: start game with Return/Enter
-void GameListTreeView::keyPressEvent(QKeyEvent *event)
+// resource images are decoded once
+QPixmap GameListDelegate::getResource(const QString &path)
 {
-	switch (event->key())
+	QPixmap pm;
+	if (!QPixmapCache::find(path, &pm))
 	{
-#ifdef Q_WS_MAC
-	case Qt::Key_Enter:
-	case Qt::Key_Return:
-		// ### we can't open the editor on enter, becuse
-		// some widgets will forward the enter event back
-		// to the viewport, starting an endless loop
-		if (state() != EditingState || hasFocus())
-		{
-			if (currentIndex().isValid())
-				emit triggered(currentIndex());
-			event->ignore();
-		}
-		break;
-#endif
-	default:
-		QTreeView::keyPressEvent(event);
-		break;
+		pm.load(path);
+		QPixmapCache::insert(path, pm);
 	}
-}
-
 
-GameListDelegate::GameListDelegate(QObject *parent) :
-QItemDelegate(parent)
-{
+	return pm;
 }
 
 QSize GameListDelegate::sizeHint(const QStyleOptionViewItem &, const QModelIndex &) const
@@ -999,14 +1639,6 @@ void GameListDelegate::paint(QPainter *painter, const QStyleOptionViewItem &opti
 	QString gameName = gameList->getViewString(index, COL_NAME);
 	GameInfo *gameInfo = gameList->getGameInfo(index, gameName);
 
-	int cloneOffset = 0;
-	//clone
-	if (gameList->listMode == "Grouped" && !gameInfo->cloneof.isEmpty())
-	{
-		if (visibleGames.contains(gameInfo->cloneof))
-			cloneOffset = 16;
-	}
-
 	QModelIndex i, pi;
 	i = gameListModel->index(COL_DESC, pMameDat->games[currentGame]->pModItem);
 
@@ -1021,73 +1653,42 @@ void GameListDelegate::paint(QPainter *painter, const QStyleOptionViewItem &opti
 	QRect rectDeco, rectText;
 	rectDeco = rectText = option.rect;
 
-	//load original icon
-	QByteArray icondata;
+	//load original icon, decoded icons are cached
 	QPixmap pmFinal, pmIcon;
-
-	if (gameInfo->icondata.isNull())
-	{
-		if (gameInfo->isExtRom || gameInfo->status == 1)
-			icondata = defIconDataGreen;
-		else if (gameInfo->status == 2)
-			icondata = defIconDataYellow;
-		else
-			icondata = defIconDataRed;
-
-		if (!pmIcon.loadFromData(icondata))
-			win->updateLog("icon error 2: cannot load");
-	}
-	else
-	{
-		icondata = gameInfo->icondata;
-		if (!pmIcon.loadFromData(icondata, "ico"))
-			win->updateLog("icon error 3: cannot load");
-	}
-
+	pmIcon = getIcon(gameInfo, gameName, 0, false);
 
 	const bool isLargeIcon = pmIcon.width() > 16;
 	const bool isZooming = win->actionRowDelegate->isChecked();
+	const bool isUnavailable = gameInfo->available != GAME_COMPLETE;
 
-	if(isLView)
-	{
-		if (currentGame == gameName)
-			pmFinal.load(isDarkBg ? ":/res/mamegui/deco-darkbg.png" : ":/res/mamegui/deco-brightbg.png");
-		else
-			pmFinal = pmIcon = pmIcon.scaled(QSize(32, 32), Qt::KeepAspectRatio, Qt::SmoothTransformation);
-	}
-	else if (isLargeIcon)
+	if ((isLView && currentGame == gameName) || 
+		(!isLView && isLargeIcon && currentGame == gameName && isZooming))
 	{
-		if (currentGame == gameName && isZooming)
-			pmFinal.load(isDarkBg ? ":/res/mamegui/deco-darkbg.png" : ":/res/mamegui/deco-brightbg.png");
-		else
-			pmFinal = pmIcon = pmIcon.scaled(QSize(16, 16), Qt::KeepAspectRatio, Qt::SmoothTransformation);
-	}
-	else
-		pmFinal = pmIcon;
+		//only the current row paints a decoration
+		pmFinal = getResource(isDarkBg ? ":/res/mamegui/deco-darkbg.png" : ":/res/mamegui/deco-brightbg.png");
 
-	//paint unavailable icon
-	QPainter p;
-	p.begin(&pmFinal);
-
-	if(isLView)
-	{
-		if(currentGame == gameName)
-			p.drawPixmap(3, 3, 32, 32, pmIcon);
-	}
-	else if (currentGame == gameName && isLargeIcon && isZooming)
+		QPainter p;
+		p.begin(&pmFinal);
 		p.drawPixmap(3, 3, 32, 32, pmIcon);
 
-	// paint the unavailable icon on top of original icon
-	if(gameInfo->available != GAME_COMPLETE)
-	{
-		int offset = 8;
-		if (currentGame == gameName && isLargeIcon && isZooming)
-			offset = 27;
+		// paint the unavailable icon on top of original icon
+		if(isUnavailable)
+		{
+			int offset = 8;
+			if (isLargeIcon && isZooming)
+				offset = 27;
 
-		p.drawPixmap(offset, offset, 8, 8, QPixmap(":/res/status-na.png"));
-	}
+			p.drawPixmap(offset, offset, 8, 8, getResource(":/res/status-na.png"));
+		}
 
-	p.end();
+		p.end();
+	}
+	else if (isLView)
+		pmFinal = getIcon(gameInfo, gameName, 32, isUnavailable);
+	else if (isLargeIcon)
+		pmFinal = getIcon(gameInfo, gameName, 16, isUnavailable);
+	else
+		pmFinal = getIcon(gameInfo, gameName, 0, isUnavailable);
 
 
 	if(isLView)
@@ -1122,13 +1723,12 @@ void GameListDelegate::paint(QPainter *painter, const QStyleOptionViewItem &opti
 				gameList->pmDeco = QPixmap();
 		}
 
-		rectDeco.setLeft(rectDeco.left() + cloneOffset);
 		rectDeco.setWidth(icoSize + 6);
 
 		if (currentGame == gameName && isLargeIcon && isZooming)
 			rectText.setLeft(rectText.left() + decoSize);
 		else
-			rectText.setLeft(rectText.left() + decoSize + cloneOffset + 6);
+			rectText.setLeft(rectText.left() + decoSize + 6);
 		drawDisplay(painter, option, rectText, gameList->getViewString(index, COL_DESC));
 
 		//paint item icon
@@ -1155,8 +1755,12 @@ Gamelist::Gamelist(QObject *parent) :
 	loadProc(NULL),
 	menuContext(NULL),
 	headerMenu(NULL),
+	actionRomUsers(NULL),
 	autoAudit(false),
 	hasInitd(false),
+	buildInitMethod(GAMELIST_INIT_FULL),
+	pendingInitMethod(-1),
+	isModelBuilding(false),
 	defaultGameListDelegate(NULL)
 {
 	//init joystick
@@ -1279,6 +1883,33 @@ void Gamelist::updateSelection(const QModelIndex & current, const QModelIndex &
 
 		selectionThread.update();
 
+		//warm the docks of the next rows in the travel direction
+		if (previous.isValid() && previous.parent() == current.parent() && previous.row() != current.row())
+		{
+			int step = current.row() > previous.row() ? 1 : -1;
+			int count = PREFETCH_ROWS;
+			if (timeLastSelection.isValid() && timeLastSelection.elapsed() < PREFETCH_FAST_INTERVAL)
+				count = PREFETCH_ROWS_FAST;
+
+			QStringList gameNames;
+			for (int i = 1; i <= count; i++)
+			{
+				QModelIndex index = current.sibling(current.row() + step * i, current.column());
+				if (!index.isValid())
+					break;
+
+				QString gameName2 = getViewString(index, COL_NAME);
+				if (gameName2.isEmpty() || !pMameDat->games.contains(gameName2))
+					continue;
+
+				getGameInfo(index, gameName2);
+				gameNames << gameName2;
+			}
+
+			selectionThread.prefetch(gameNames);
+		}
+		timeLastSelection.start();
+
 #ifdef Q_OS_WIN
 		//fixme: move to thread!
 		if (win->m1Core != NULL && win->m1Core->available)
@@ -1295,6 +1926,104 @@ void Gamelist::updateSelection(const QModelIndex & current, const QModelIndex &
 //	win->log("currentGame: " + currentGame);
 }
 
+// apply incremental audit results to the game list rows
+void Gamelist::updateGames(const QStringList &gameNames)
+{
+	if (gameListModel == NULL || gameListPModel == NULL || !hasInitd)
+		return;
+
+	QList<GameInfo *> gameInfos;
+	foreach (QString gameName, gameNames)
+	{
+		GameInfo *gameInfo = pMameDat->games.value(gameName);
+		if (gameInfo != NULL)
+			gameInfos << gameInfo;
+	}
+
+	gameListModel->updateGameRows(gameInfos);
+
+	if (gameNames.contains(currentGame))
+		updateSelection();
+}
+
+// a full audit has updated the changed rows of the shown list, otherwise the list is built again
+void Gamelist::postAudit()
+{
+	//the model being built finishes the same way
+	if (isBuildingModel())
+		return;
+
+	if (gameListModel == NULL || gameListPModel == NULL || !hasInitd)
+	{
+		init(true, GAMELIST_INIT_AUDIT);
+		return;
+	}
+
+	//rows and their folder bits have been updated as the results were applied
+	win->enableCtrls(true);
+
+	//save fixdat
+	win->romAuditor->exportDat();
+
+	updateSelection();
+}
+
+// sync ext roms of a console with a rescan of its software directory
+void Gamelist::updateExtRoms(const QString &consoleName, const QStringList &keys, const QStringList &descriptions)
+{
+	//the worker is reading the dat, sync after the swap
+	if (isBuildingModel())
+	{
+		pendingExtRoms[consoleName] = qMakePair(keys, descriptions);
+		return;
+	}
+
+	GameInfo *consoleInfo = pMameDat->games.value(consoleName);
+	if (consoleInfo == NULL)
+		return;
+
+	//a list that is not shown is built again after the audit
+	const bool isListShown = gameListModel != NULL && gameListPModel != NULL && hasInitd;
+
+	//remove vanished files
+	foreach (QString gameName, pMameDat->games.keys())
+	{
+		GameInfo *gameInfo = pMameDat->games[gameName];
+		if (!gameInfo->isExtRom || gameInfo->romof != consoleName || keys.contains(gameName))
+			continue;
+
+		if (gameName == currentGame)
+			currentGame = consoleName;
+
+		if (isListShown)
+			gameListModel->removeGameRow(gameInfo);
+		pMameDat->games.remove(gameName);
+		delete gameInfo;
+	}
+
+	//add new files
+	QStringList newNames;
+	for (int i = 0; i < keys.size(); i++)
+	{
+		if (pMameDat->games.contains(keys[i]))
+			continue;
+
+		GameInfo *gameInfo = new GameInfo(pMameDat);
+		gameInfo->description = descriptions[i];
+		gameInfo->isExtRom = true;
+		gameInfo->romof = consoleName;
+		gameInfo->sourcefile = consoleInfo->sourcefile;
+		gameInfo->available = GAME_COMPLETE;
+		gameInfo->icon = consoleInfo->icon;
+		gameInfo->isHorz = consoleInfo->isHorz;
+		pMameDat->games[keys[i]] = gameInfo;
+		newNames << keys[i];
+	}
+
+	if (isListShown)
+		gameListModel->insertGameRows(newNames);
+}
+
 void Gamelist::restoreGameSelection()
 {
 	if (gameListModel == NULL || gameListPModel == NULL || !hasInitd)
@@ -1308,11 +2037,15 @@ void Gamelist::restoreGameSelection()
 	QModelIndex currIndex, proxyIndex;
 
 	// select current game
-	currIndex = gameListModel->index(COL_DESC, gameInfo->pModItem);
+	currIndex = gameListModel->gameIndex(gameInfo, COL_DESC);
 
 	if (currIndex.isValid())
 		proxyIndex = gameListPModel->mapFromSource(currIndex);
 
+	// show a selected clone
+	if (proxyIndex.parent().isValid())
+		win->tvGameList->expand(proxyIndex.parent());
+
 	// select first row otherwise
 	if (!proxyIndex.isValid())
 		proxyIndex = gameListPModel->index(0, 0, QModelIndex());
@@ -1384,35 +2117,40 @@ void Gamelist::setupSnap(int snapType)
 //	if (!selectionThread.done)
 //		return;
 
+	QVector<QImage> levels;
+	QImage fitted;
+
 	switch (snapType)
 	{
 	case DOCK_SNAP:
 	case DOCK_TITLE:
-		((Screenshot*)win->dockCtrls[snapType])->setPixmap(selectionThread.pmSnapData[snapType], win->actionEnforceAspect->isChecked());
+		selectionThread.snapImage(snapType, levels, fitted);
+		((Screenshot*)win->dockCtrls[snapType])->setImage(levels, fitted, win->actionEnforceAspect->isChecked());
 		break;
 	case DOCK_FLYER:
 	case DOCK_CABINET:
 	case DOCK_MARQUEE:
 	case DOCK_CPANEL:
 	case DOCK_PCB:
-		((Screenshot*)win->dockCtrls[snapType])->setPixmap(selectionThread.pmSnapData[snapType], false);
+		selectionThread.snapImage(snapType, levels, fitted);
+		((Screenshot*)win->dockCtrls[snapType])->setImage(levels, fitted, false);
 		break;
 	case DOCK_HISTORY:
-		win->tbHistory->setHtml(selectionThread.historyText);
+		win->tbHistory->setHtml(selectionThread.docText(snapType));
 		break;
 	case DOCK_MAMEINFO:
-		win->tbMameinfo->setHtml(selectionThread.mameinfoText);
+		win->tbMameinfo->setHtml(selectionThread.docText(snapType));
 		break;
 
 	case DOCK_DRIVERINFO:
-		win->tbDriverinfo->setHtml(selectionThread.driverinfoText);
+		win->tbDriverinfo->setHtml(selectionThread.docText(snapType));
 		break;
 
 	case DOCK_STORY:
-		win->tbStory->setHtml(selectionThread.storyText);
+		win->tbStory->setHtml(selectionThread.docText(snapType));
 		break;
 	case DOCK_COMMAND:
-		win->tbCommand->setHtml(selectionThread.commandText);
+		win->tbCommand->setHtml(selectionThread.docText(snapType));
 		break;
 	default:
 		break;
@@ -1436,17 +2174,17 @@ void Gamelist::disableCtrls()
 	// these are reenabled in gameList->init()
 	win->enableCtrls(false);
 
-	//delete model
+	//delete model, the view and queued signals may still refer to it
 	if (gameListModel)
 	{
-		delete gameListModel;
+		gameListModel->deleteLater();
 		gameListModel = NULL;
 	}
 
 	//delete proxy model
 	if (gameListPModel)
 	{
-		delete gameListPModel;
+		gameListPModel->deleteLater();
 		gameListPModel = NULL;
 	}
 }
@@ -1462,6 +2200,14 @@ void Gamelist::init(bool toggleState, int initMethod)
 	if (!toggleState)
 		return;
 
+	//a model is being built, init again when it's done, but never skip the work of a full init
+	if (isBuildingModel())
+	{
+		if (pendingInitMethod != GAMELIST_INIT_FULL)
+			pendingInitMethod = buildInitMethod == GAMELIST_INIT_FULL ? GAMELIST_INIT_FULL : initMethod;
+		return;
+	}
+
 	//have to init here instead of in the constructor, after isMESS has been assigned
 	if (!hasInitd)
 	{
@@ -1503,55 +2249,24 @@ void Gamelist::init(bool toggleState, int initMethod)
 	foreach (QString folderName, intFolderNames0)
 		intFolderNames << tr(qPrintable(folderName));
 
-	bool isLView = false;
-
-	// get current game list mode
+	// get current game list mode, the current list is shown in its own mode until the swap
 	if (win->actionDetails->isChecked())
 	{
-		listMode = "Details";
+		buildListMode = "Details";
 	}
 	else if (win->actionLargeIcons->isChecked())
 	{
-		listMode = "LargeIcons";
-		isLView = true;
+		buildListMode = "LargeIcons";
 	}
 	else
-		listMode = "Grouped";
+		buildListMode = "Grouped";
 
 	//validate currentGame
 	if (!pMameDat->games.contains(currentGame))
 		currentGame = pMameDat->games.keys().first();
 
-	disableCtrls();
-
-	//init the model
-	gameListModel = new TreeModel(win);
-	gameListPModel = new GameListSortFilterProxyModel(win);
-
-	gameListPModel->setSourceModel(gameListModel);
-	gameListPModel->setSortCaseSensitivity(Qt::CaseInsensitive);
-
-	if (isLView)
-	{
-		win->layMainView->addWidget(win->lvGameList);
-		win->lvGameList->show();
-		win->lvGameList->setModel(gameListPModel);
-
-		if (defaultGameListDelegate == NULL)
-			defaultGameListDelegate = win->lvGameList->itemDelegate();
-
-		win->lvGameList->setItemDelegate(&gamelistDelegate);
-	}
-	else
-	{
-		win->layMainView->addWidget(win->tvGameList);
-		win->tvGameList->show();
-		win->tvGameList->setModel(gameListPModel);
-		if (defaultGameListDelegate == NULL)
-			defaultGameListDelegate = win->tvGameList->itemDelegate();
-
-		win->tvGameList->setItemDelegate(&gamelistDelegate);
-	}
+	//keep showing the current list until the new model is swapped in
+	win->enableCtrls(false);
 	win->show();
 
 	if (initMethod == GAMELIST_INIT_FULL)
@@ -1585,6 +2300,94 @@ void Gamelist::init(bool toggleState, int initMethod)
 		loadMMO(UI_MSG_MANUFACTURE);
 	}
 
+	//the worker reads a copy of the game list, audit results wait until the swap
+	QList<QPair<QString, GameInfo *> > games;
+	foreach (QString gameName, pMameDat->games.keys())
+		games << qMakePair(gameName, pMameDat->games[gameName]);
+
+	//build the model and its indexes in a background thread, postBuildModel() continues the init
+	buildInitMethod = initMethod;
+	isModelBuilding = true;
+	disconnect(&buildModelWatcher, SIGNAL(finished()), this, SLOT(postBuildModel()));
+	connect(&buildModelWatcher, SIGNAL(finished()), this, SLOT(postBuildModel()));
+	QFuture<TreeModel *> future = QtConcurrent::run(&Gamelist::buildModel, games, buildListMode == "Grouped");
+	buildModelWatcher.setFuture(future);
+}
+
+// true until postBuildModel() has swapped the new model in, not only while the worker runs
+bool Gamelist::isBuildingModel()
+{
+	return isModelBuilding;
+}
+
+// localized strings are loaded before, so they are indexed as well
+TreeModel * Gamelist::buildModel(QList<QPair<QString, GameInfo *> > games, bool isGrouped)
+{
+	TreeModel *model = new TreeModel(games, isGrouped);
+	model->buildIndexes();
+
+	//hand the model over to the GUI thread
+	model->moveToThread(QCoreApplication::instance()->thread());
+	return model;
+}
+
+void Gamelist::postBuildModel()
+{
+	TreeModel *model = buildModelWatcher.result();
+	int initMethod = buildInitMethod;
+
+	isModelBuilding = false;
+
+	//init was requested again while building, the model is stale
+	if (pendingInitMethod >= 0)
+	{
+		delete model;
+		initMethod = pendingInitMethod;
+		pendingInitMethod = -1;
+		init(true, initMethod);
+		return;
+	}
+
+	//swap in the new model, only the view reset is left to the GUI thread
+	disableCtrls();
+
+	listMode = buildListMode;
+	const bool isLView = listMode == "LargeIcons";
+
+	gameListModel = model;
+	gameListModel->setParent(win);
+	gameListModel->attachItems();
+	gameListPModel = new GameListSortFilterProxyModel(win);
+
+	gameListPModel->setSourceModel(gameListModel);
+	gameListPModel->setSortCaseSensitivity(Qt::CaseInsensitive);
+
+	if (isLView)
+	{
+		win->layMainView->addWidget(win->lvGameList);
+		win->lvGameList->show();
+		win->lvGameList->setModel(gameListPModel);
+
+		if (defaultGameListDelegate == NULL)
+			defaultGameListDelegate = win->lvGameList->itemDelegate();
+
+		win->lvGameList->setItemDelegate(&gamelistDelegate);
+	}
+	else
+	{
+		win->layMainView->addWidget(win->tvGameList);
+		win->tvGameList->show();
+		//clones are children of their parent in grouped mode
+		win->tvGameList->setRootIsDecorated(listMode == "Grouped");
+		win->tvGameList->setItemsExpandable(listMode == "Grouped");
+		win->tvGameList->setModel(gameListPModel);
+		if (defaultGameListDelegate == NULL)
+			defaultGameListDelegate = win->tvGameList->itemDelegate();
+
+		win->tvGameList->setItemDelegate(&gamelistDelegate);
+	}
+	win->show();
+
 	// init folders must be called after init of localization so that folder names are translated
 	if (initMethod == GAMELIST_INIT_FULL && !hasInitd)
 		initFolders();
@@ -1662,6 +2465,20 @@ void Gamelist::init(bool toggleState, int initMethod)
 	hasInitd = true;
 //	win->log(QString("init'd %1 games").arg(pMameDat->games.size()));
 
+	//audit results held off while building
+	foreach (QString consoleName, pendingExtRoms.keys())
+		updateExtRoms(consoleName, pendingExtRoms[consoleName].first, pendingExtRoms[consoleName].second);
+	pendingExtRoms.clear();
+	QMetaObject::invokeMethod(win->romAuditor, "applyResults", Qt::QueuedConnection);
+
+	//pick up roms added or removed from now on, the dirs are set again when the paths change
+	if (initMethod == GAMELIST_INIT_FULL)
+		win->romWatcher->watch();
+
+	//paths or the dats may have changed
+	selectionThread.clearCache();
+	selectionThread.updateThumbnails();
+
 	//for re-init list from folders
 	restoreGameSelection();
 	updateSelection();
@@ -1678,55 +2495,130 @@ void Gamelist::loadIcon()
 
 void Gamelist::loadIconWorkder()
 {
-	GameInfo *gameInfo, *gameInfo2;
+	QString stamp = iconStamp();
+
+	if (IconPack::load(stamp, loadedIcons))
+	{
+		win->log(QString("loaded %1 icons from cache.").arg(loadedIcons.size()));
+		return;
+	}
 
 	QHash<QString, MameFileInfo *> mameFileInfoList =
 		utils->iterateMameFile(mameOpts["icons_directory"]->globalvalue, "icons;.", "*" ICO_EXT, MAMEFILE_READ);
 
-	foreach (QString key, mameFileInfoList.keys())
-	{
-		QString gameName = key;
-		gameName.chop(4 /* sizeof ICO_EXT */);
-		if (pMameDat->games.contains(gameName))
-		{
-			gameInfo = pMameDat->games[gameName];
-			gameInfo->icondata = mameFileInfoList[key]->data;
-		}
-	}
+	//the pack only depends on the icon sources, so keep icons of games the current dat does not know yet
+	QStringList gameNames;
+	QList<QByteArray> icoDataList;
+	foreach (QString key, mameFileInfoList.keys())
+	{
+		QString gameName = key;
+		gameName.chop(4 /* sizeof ICO_EXT */);
+		gameNames << gameName;
+		icoDataList << mameFileInfoList[key]->data;
+	}
+
+	utils->clearMameFileInfoList(mameFileInfoList);
+
+	// decode on all cores
+	QList<GameIcon *> icons = QtConcurrent::blockingMapped<QList<GameIcon *> >(icoDataList, &Gamelist::decodeIcon);
+	icoDataList.clear();
+
+	for (int i = 0; i < icons.size(); i++)
+		if (icons[i] != NULL)
+			loadedIcons[gameNames[i]] = icons[i];
+
+	win->log(QString("decoded %1 icons.").arg(loadedIcons.size()));
+
+	if (!IconPack::save(stamp, loadedIcons))
+		win->log("failed to save icons.cache");
+}
+
+// the icon sources and their timestamps, the pack is rebuilt when any of them changes
+QString Gamelist::iconStamp()
+{
+	QString stamp;
+	QStringList dirPaths = mameOpts["icons_directory"]->globalvalue.split(";");
+
+	foreach (QString dirPath, dirPaths)
+	{
+		if (dirPath.isEmpty())
+			continue;
+
+		dirPath = utils->getPath(dirPath);
+
+		QStringList sources;
+		sources << dirPath + "icons" ZIP_EXT << dirPath + "icons" SZIP_EXT << dirPath + "icons" << dirPath;
+		foreach (QString source, sources)
+		{
+			QFileInfo fileInfo(source);
+			if (fileInfo.exists())
+				stamp += QString("%1:%2:%3;").arg(source).arg(fileInfo.size())
+					.arg(fileInfo.lastModified().toMSecsSinceEpoch());
+		}
+	}
+
+	return stamp;
+}
+
+// decode an ICO into premultiplied bitmaps of list sizes
+GameIcon *Gamelist::decodeIcon(const QByteArray &icoData)
+{
+	QImage image;
+	if (!image.loadFromData(icoData, "ico"))
+		return NULL;
+
+	image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+	if (image.width() > ICON_SIZE || image.height() > ICON_SIZE)
+		image = image.scaled(ICON_SIZE, ICON_SIZE, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+	GameIcon *icon = new GameIcon();
+	icon->image = image;
+	icon->image16 = image.scaled(ICON_SIZE_SMALL, ICON_SIZE_SMALL, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+
+	return icon;
+}
+
+void Gamelist::postLoadIcon()
+{
+	GameInfo *gameInfo, *gameInfo2;
+
+	foreach (gameInfo, pMameDat->games)
+		gameInfo->icon = NULL;
 
-	utils->clearMameFileInfoList(mameFileInfoList);
+	foreach (QString gameName, loadedIcons.keys())
+		if (pMameDat->games.contains(gameName))
+			pMameDat->games[gameName]->icon = loadedIcons[gameName];
 
-	//complete data
-	foreach (QString gameName, pMameDat->games.keys())
+	//share icons by reference, clones first as a system can be a clone
+	foreach (gameInfo, pMameDat->games)
 	{
-		gameInfo = pMameDat->games[gameName];
-
 		// get clone icons from parent
-		if (!gameInfo->isExtRom && gameInfo->icondata.isNull() && !gameInfo->cloneof.isEmpty())
+		if (gameInfo->icon == NULL && !gameInfo->isExtRom && !gameInfo->cloneof.isEmpty())
 		{
-			gameInfo2 = pMameDat->games[gameInfo->cloneof];
-			if (!gameInfo2->icondata.isNull())
-			{
-				gameInfo->icondata = gameInfo2->icondata;
-//				emit icoUpdated(gameName);
-			}
+			gameInfo2 = pMameDat->games.value(gameInfo->cloneof);
+			if (gameInfo2 != NULL)
+				gameInfo->icon = gameInfo2->icon;
 		}
+	}
 
+	foreach (gameInfo, pMameDat->games)
+	{
 		// get ext rom icons from system
-		if (gameInfo->isExtRom && gameInfo->icondata.isNull())
+		if (gameInfo->icon == NULL && gameInfo->isExtRom)
 		{
-			gameInfo2 = pMameDat->games[gameInfo->romof];
-			if (!gameInfo2->icondata.isNull())
-			{
-				gameInfo->icondata = gameInfo2->icondata;
-//				emit icoUpdated(gameName);
-			}
+			gameInfo2 = pMameDat->games.value(gameInfo->romof);
+			if (gameInfo2 != NULL)
+				gameInfo->icon = gameInfo2->icon;
 		}
 	}
-}
 
-void Gamelist::postLoadIcon()
-{
+	qDeleteAll(gameIcons);
+	gameIcons = loadedIcons;
+	loadedIcons.clear();
+
+	//cached pixmaps are keyed by icon address, which a later icon may reuse
+	QPixmapCache::clear();
+
 	win->lvGameList->update(win->lvGameList->rect());
 	win->tvGameList->update(win->tvGameList->rect());
 }
@@ -1954,6 +2846,9 @@ void Gamelist::initMenus()
 		menuContext->addAction(win->actionRemoveFromFolder);
 		menuContext->addSeparator();
 		menuContext->addAction(win->actionAudit);
+		actionRomUsers = new QAction(tr("Sets Using These ROMs"), menuContext);
+		connect(actionRomUsers, SIGNAL(triggered()), this, SLOT(showRomUsers()));
+		menuContext->addAction(actionRomUsers);
 		menuContext->addSeparator();
 		menuContext->addAction(win->actionSrcProperties);
 		menuContext->addAction(win->actionProperties);
@@ -2029,9 +2924,9 @@ void Gamelist::updateContextMenu()
 	QString gameName = currentGame;
 	GameInfo *gameInfo = pMameDat->games[gameName];
 
-	QPixmap pm;
-	pm.loadFromData(gameInfo->icondata, "ico");
-	QIcon icon(pm);
+	QIcon icon;
+	if (gameInfo->icon != NULL)
+		icon = QIcon(QPixmap::fromImage(gameInfo->icon->image));
 
 	win->actionPlay->setIcon(icon);
     win->actionPlay->setText(tr("Play %1")
@@ -2065,6 +2960,9 @@ void Gamelist::updateContextMenu()
 		.arg((extSubFolderName != ROOT_FOLDER) ? "/" + extSubFolderName : ""));
 	win->actionRemoveFromFolder->setEnabled(isAccessable);
 
+	//rom menu
+	actionRomUsers->setEnabled(!gameInfo->roms.isEmpty());
+
 	//prop menu
 	win->actionSrcProperties->setText(tr("Properties for %1").arg(gameInfo->sourcefile));
 
@@ -2072,6 +2970,45 @@ void Gamelist::updateContextMenu()
 	updateDynamicMenu(menuContext);
 }
 
+// list the other sets that use any rom of the current game
+void Gamelist::showRomUsers()
+{
+	static const int maxLines = 40;
+
+	GameInfo *gameInfo = pMameDat->games.value(currentGame);
+	if (gameInfo == NULL)
+		return;
+
+	QMap<QString, int> romUsers;
+	QHashIterator<quint32, RomInfo *> it(gameInfo->roms);
+	while (it.hasNext())
+	{
+		it.next();
+		foreach (QString gameName, pMameDat->gamesUsingRom(it.key(), it.value()->size))
+			if (gameName != currentGame)
+				romUsers[gameName]++;
+	}
+
+	if (romUsers.isEmpty())
+	{
+		win->poplog(tr("No other set uses the ROMs of %1.").arg(currentGame));
+		return;
+	}
+
+	QStringList lines;
+	foreach (QString gameName, romUsers.keys())
+	{
+		if (lines.size() == maxLines)
+		{
+			lines << tr("... and %1 more").arg(romUsers.size() - maxLines);
+			break;
+		}
+		lines << tr("%1: %2 ROMs").arg(gameName).arg(romUsers[gameName]);
+	}
+
+	win->poplog(tr("Sets using the ROMs of %1:").arg(currentGame) + "\n\n" + lines.join("\n"));
+}
+
 void Gamelist::updateDynamicMenu(QMenu *rootMenu)
 {
 	const QString gameName = currentGame;
@@ -2305,6 +3242,7 @@ void Gamelist::mountDevice()
 		return;
 
 	deviceInfo->mountedPath = fileName;
+	pMameDat->save();
 }
 
 void Gamelist::unmountDevice()
@@ -2319,6 +3257,7 @@ void Gamelist::unmountDevice()
 		{
 			DeviceInfo *deviceInfo = gameInfo->devices[instanceName];
 			deviceInfo->mountedPath.clear();
+			pMameDat->save();
 			break;
 		}
 	}
@@ -2484,10 +3423,7 @@ void Gamelist::filterFlagsChanged(bool isChecked)
 
 	// set it for a callback to refresh the list
 	gameListPModel->setFilterRegExp(emptyRegex);
-
-	//fixme: must have this, otherwise the list cannot be expanded properly
 	qApp->processEvents();
-	win->tvGameList->expandAll();
 
 	restoreGameSelection();
 //	win->log(QString("filterFlags: %1").arg(filterFlags));
@@ -2520,7 +3456,6 @@ void Gamelist::filterSearchChanged()
 	// set it for a callback to refresh the list
 	gameListPModel->setFilterRegExp(emptyRegex);
 	qApp->processEvents();
-	win->tvGameList->expandAll();
 	restoreGameSelection();
 }
 
@@ -2657,10 +3592,7 @@ void Gamelist::filterFolderChanged(QTreeWidgetItem *_current, QTreeWidgetItem */
 	// set it for a callback to refresh the list
 	gameListPModel->filterText = filterText;	// must set before regExp
 	gameListPModel->setFilterRegExp(emptyRegex);
-
-	//fixme: must have this, otherwise the list cannot be expanded properly
 	qApp->processEvents();
-	win->tvGameList->expandAll();
 
 	restoreGameSelection();
 }
@@ -3592,11 +4524,514 @@ void Gamelist::runMameFinished(int exitCode, QProcess::ExitStatus exitStatus)
 
 
 GameListSortFilterProxyModel::GameListSortFilterProxyModel(QObject *parent) :
-	QSortFilterProxyModel(parent)
+	QSortFilterProxyModel(parent),
+	folderRole(-1),
+	folderGeneration(-1),
+	searchGeneration(-1)
+{
+}
+
+FolderFilter::FolderFilter() :
+size(0),
+builds(0)
+{
+}
+
+QString FolderFilter::postingKey(int role, const QString &filterText)
+{
+	return QString::number(role) + "\t" + filterText;
+}
+
+void FolderFilter::add(int role, const QString &filterText, int id)
+{
+	QVector<int> &posting = postings[postingKey(role, filterText)];
+
+	//a game can have several chips or displays of the same kind
+	if (posting.isEmpty() || posting.last() != id)
+		posting.append(id);
+}
+
+// evaluate the folders of every row once, folders without a filterText use an empty one
+void FolderFilter::build(const GameTable &gameTable)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	size = gameTable.size();
+	builds++;
+
+	clones.fill(false, size);
+	extRoms.fill(false, size);
+	working.fill(false, size);
+	available.fill(false, size);
+	mechanical.fill(false, size);
+	postings.clear();
+	gameNames.fill(QString(), size);
+	ids.clear();
+
+	const QString strHorz = GameListSortFilterProxyModel::tr("Horizontal");
+	const QString strVert = GameListSortFilterProxyModel::tr("Vertical");
+
+	for (int id = 0; id < size; id++)
+	{
+		GameInfo *gameInfo = gameTable.gameInfo(id);
+		if (gameInfo == NULL)
+			continue;
+
+		const QString &gameNameExtRom = gameTable.string(id, COL_NAME);
+
+		//same as the view, ext roms are shown by the name of their system
+		QString gameName = gameInfo->isExtRom ? gameInfo->romof : gameNameExtRom;
+		gameInfo = gameTable.gameInfo(gameName);
+
+		//del device game
+		if (gameInfo == NULL || gameInfo->isDevice)
+			continue;
+
+		gameNames[id] = gameNameExtRom;
+		ids[gameNameExtRom] = id;
+
+		if (!gameInfo->devices.isEmpty() && gameName != gameNameExtRom)
+			gameInfo = gameTable.gameInfo(id);
+
+		//fixme: how to filter MESS games
+		const bool isConsole = !gameInfo->softwarelists.isEmpty();
+		const bool isBIOS = gameInfo->isBios;
+		const bool isExtRom = gameInfo->isExtRom;
+		const bool isClone = !gameInfo->cloneof.isEmpty();
+		const bool isMechanical = gameInfo->isMechanical;
+
+		clones.setBit(id, isClone);
+		extRoms.setBit(id, isExtRom);
+		working.setBit(id, gameInfo->status);
+		available.setBit(id, gameInfo->available == GAME_COMPLETE);
+		mechanical.setBit(id, isMechanical);
+
+		// folders without subfolders
+		if (!isBIOS && !isExtRom && (isMESS || !isConsole))
+		{
+			add(Qt::UserRole + FOLDER_ALLARC, "", id);
+			//completed by the audit result
+			add(Qt::UserRole + FOLDER_AVAILABLE, "", id);
+			add(Qt::UserRole + FOLDER_UNAVAILABLE, "", id);
+		}
+		if (!isExtRom && isConsole)
+			add(Qt::UserRole + FOLDER_CONSOLE, "", id);
+		if (isBIOS)
+			add(Qt::UserRole + FOLDER_BIOS, "", id);
+		if (!gameInfo->disks.isEmpty())
+			add(Qt::UserRole + FOLDER_HARDDISK, "", id);
+		if (!gameInfo->samples.isEmpty())
+			add(Qt::UserRole + FOLDER_SAMPLES, "", id);
+		if (!isExtRom && gameInfo->status)
+			add(Qt::UserRole + FOLDER_WORKING, "", id);
+		if (!isExtRom && !gameInfo->status)
+			add(Qt::UserRole + FOLDER_NONWORKING, "", id);
+		if (!isBIOS && !isExtRom && !isClone)
+			add(Qt::UserRole + FOLDER_ORIGINALS, "", id);
+		if (!isBIOS && !isExtRom && isClone)
+			add(Qt::UserRole + FOLDER_CLONES, "", id);
+		if (!isExtRom && gameInfo->savestate)
+			add(Qt::UserRole + FOLDER_SAVESTATE, "", id);
+		if (!isBIOS && !isExtRom && isMechanical)
+			add(Qt::UserRole + FOLDER_MECHANICAL, "", id);
+		if (!isBIOS && !isExtRom && !isMechanical)
+			add(Qt::UserRole + FOLDER_NONMECHANICAL, "", id);
+		if (!isBIOS)
+			add(Qt::UserRole + FOLDER_ALLGAME, "", id);
+
+		// subfolders
+		if (isExtRom)
+			add(Qt::UserRole + FOLDER_CONSOLE + MAX_FOLDERS, gameName, id);
+
+		if (!isBIOS)
+		{
+			add(Qt::UserRole + FOLDER_MANUFACTURER, gameInfo->manufacturer, id);
+			add(Qt::UserRole + FOLDER_YEAR, gameInfo->year.isEmpty() ? "?" : gameInfo->year, id);
+			add(Qt::UserRole + FOLDER_BIOS + MAX_FOLDERS, gameInfo->biosof(), id);
+		}
+
+		add(Qt::UserRole + FOLDER_SOURCE, gameInfo->sourcefile, id);
+
+		foreach (ChipInfo *chipInfo, gameInfo->chips)
+		{
+			if (chipInfo->type == "cpu")
+				add(Qt::UserRole + FOLDER_CPU, chipInfo->name, id);
+			else if (chipInfo->type == "audio")
+				add(Qt::UserRole + FOLDER_SND, chipInfo->name, id);
+		}
+
+		foreach (DiskInfo *disksInfo, gameInfo->disks)
+			add(Qt::UserRole + FOLDER_HARDDISK + MAX_FOLDERS, utils->getLongName(disksInfo->region), id);
+
+		foreach (RomInfo *romsInfo, gameInfo->roms)
+			add(Qt::UserRole + FOLDER_DUMPING, utils->getLongName(romsInfo->status), id);
+		foreach (DiskInfo *disksInfo, gameInfo->disks)
+			add(Qt::UserRole + FOLDER_DUMPING, utils->getLongName(disksInfo->status), id);
+
+		if (isExtRom)
+			continue;
+
+		add(Qt::UserRole + FOLDER_DISPLAY, gameInfo->isHorz ? strHorz : strVert, id);
+		for (int i = 0; i < gameInfo->displays.size(); i++)
+		{
+			DisplayInfo *displaysInfo = gameInfo->displays[i];
+			add(Qt::UserRole + FOLDER_DISPLAY, utils->getLongName(displaysInfo->type), id);
+			add(Qt::UserRole + FOLDER_RESOLUTION, gameList->getResolution(gameInfo, i), id);
+			add(Qt::UserRole + FOLDER_REFRESH, displaysInfo->refresh + " Hz", id);
+		}
+
+		add(Qt::UserRole + FOLDER_PALETTESIZE, QString::number(gameInfo->palettesize), id);
+		add(Qt::UserRole + FOLDER_CHANNELS, QString::number(gameInfo->channels), id);
+
+		add(Qt::UserRole + FOLDER_CONTROLS, QString("%1P").arg(gameInfo->players), id);
+		foreach (ControlInfo *controlsInfo, gameInfo->controls)
+			add(Qt::UserRole + FOLDER_CONTROLS, utils->getLongName(controlsInfo->type), id);
+	}
+
+	win->log(QString("indexed %1 folders of %2 rows in %3 ms.")
+		.arg(postings.size()).arg(size).arg(timer.elapsed()));
+}
+
+void FolderFilter::setAvailable(int id, bool isAvailable)
+{
+	if (contains(id))
+		available.setBit(id, isAvailable);
+}
+
+// rows added after the build are filtered the slow way
+bool FolderFilter::contains(int id) const
+{
+	return id >= 0 && id < size;
+}
+
+int FolderFilter::generation() const
+{
+	return builds;
+}
+
+bool FolderFilter::isAvailable(int id) const
+{
+	return available.testBit(id);
+}
+
+bool FolderFilter::acceptsFlags(int id, quint16 filterFlags) const
+{
+	if (extRoms.testBit(id))
+		return true;
+
+	if (F_CLONES & filterFlags && clones.testBit(id))
+		return false;
+	if (F_NONWORKING & filterFlags && !working.testBit(id))
+		return false;
+	if (F_UNAVAILABLE & filterFlags && !available.testBit(id))
+		return false;
+	if (F_MECHANICAL & filterFlags && mechanical.testBit(id))
+		return false;
+
+	return true;
+}
+
+// the rows of a folder, before applying the filter flags and the audit result
+QBitArray FolderFilter::folderBits(int role, const QString &filterText, const QStringList &filterList) const
+{
+	QBitArray bits(size);
+
+	if (role == Qt::UserRole + FOLDER_EXT)
+	{
+		QBitArray bios(size);
+		foreach (int id, postings.value(postingKey(Qt::UserRole + FOLDER_BIOS, "")))
+			bios.setBit(id);
+
+		foreach (QString gameName, filterList)
+		{
+			int id = ids.value(gameName, -1);
+			if (id >= 0 && !bios.testBit(id))
+				bits.setBit(id);
+		}
+
+		return bits;
+	}
+
+	switch (role)
+	{
+	case Qt::UserRole + FOLDER_CONSOLE + MAX_FOLDERS:
+	case Qt::UserRole + FOLDER_MANUFACTURER:
+	case Qt::UserRole + FOLDER_YEAR:
+	case Qt::UserRole + FOLDER_SOURCE:
+	case Qt::UserRole + FOLDER_CPU:
+	case Qt::UserRole + FOLDER_SND:
+	case Qt::UserRole + FOLDER_HARDDISK + MAX_FOLDERS:
+	case Qt::UserRole + FOLDER_DUMPING:
+	case Qt::UserRole + FOLDER_DISPLAY:
+	case Qt::UserRole + FOLDER_RESOLUTION:
+	case Qt::UserRole + FOLDER_PALETTESIZE:
+	case Qt::UserRole + FOLDER_REFRESH:
+	case Qt::UserRole + FOLDER_CONTROLS:
+	case Qt::UserRole + FOLDER_CHANNELS:
+	case Qt::UserRole + FOLDER_BIOS + MAX_FOLDERS:
+		foreach (int id, postings.value(postingKey(role, filterText)))
+			bits.setBit(id);
+		break;
+
+	default:
+		// empty list for unknown roles
+		foreach (int id, postings.value(postingKey(role, "")))
+			bits.setBit(id);
+	}
+
+	return bits;
+}
+
+QString FolderFilter::gameName(int id) const
+{
+	return gameNames[id];
+}
+
+SearchIndex::SearchIndex() :
+size(0),
+builds(0)
+{
+}
+
+quint64 SearchIndex::trigram(const QChar *c)
+{
+	return ((quint64)c[0].unicode() << 32) | ((quint64)c[1].unicode() << 16) | c[2].unicode();
+}
+
+// index everything a search can match, the strings of a row are separated so that no trigram spans two of them
+void SearchIndex::build(const GameTable &gameTable)
+{
+	QElapsedTimer timer;
+	timer.start();
+
+	size = gameTable.size();
+	builds++;
+
+	postings.clear();
+
+	QSet<quint64> trigrams;
+	for (int id = 0; id < size; id++)
+	{
+		GameInfo *gameInfo = gameTable.gameInfo(id);
+		if (gameInfo == NULL)
+			continue;
+
+		const QString &gameNameExtRom = gameTable.string(id, COL_NAME);
+
+		//ext roms are shown by the name of their system
+		QString gameName = gameInfo->isExtRom ? gameInfo->romof : gameNameExtRom;
+		GameInfo *gameInfo2 = gameTable.gameInfo(gameName);
+		if (gameInfo2 == NULL)
+			continue;
+
+		QStringList fields;
+		fields << gameName << gameInfo->description << gameInfo->lcDesc << gameInfo2->description
+			<< gameInfo->manufacturer << gameInfo->lcMftr;
+
+		trigrams.clear();
+		foreach (QString field, fields)
+		{
+			field = field.toLower();
+			const QChar *c = field.constData();
+			for (int i = 0; i + 2 < field.size(); i++)
+				trigrams.insert(trigram(c + i));
+		}
+
+		foreach (quint64 key, trigrams)
+			postings[key].append(id);
+	}
+
+	//rows are visited in id order, so postings are sorted
+	win->log(QString("indexed %1 trigrams of %2 rows for searching in %3 ms.")
+		.arg(postings.size()).arg(size).arg(timer.elapsed()));
+}
+
+bool SearchIndex::contains(int id) const
+{
+	return id >= 0 && id < size;
+}
+
+int SearchIndex::generation() const
+{
+	return builds;
+}
+
+// rows that contain every trigram of the literal parts of a wildcard pattern
+QBitArray SearchIndex::candidates(const QString &pattern) const
 {
+	QStringList fragments;
+	QString fragment;
+	const QString text = pattern.toLower();
+
+	for (int i = 0; i < text.size(); i++)
+	{
+		const QChar c = text.at(i);
+		if (c == '*' || c == '?' || c == '[')
+		{
+			fragments << fragment;
+			fragment.clear();
+
+			//skip a character set
+			if (c == '[')
+				while (i < text.size() && text.at(i) != ']')
+					i++;
+		}
+		else
+			fragment.append(c);
+	}
+	fragments << fragment;
+
+	QList<const QVector<int> *> lists;
+	foreach (QString fragment, fragments)
+	{
+		const QChar *c = fragment.constData();
+		for (int i = 0; i + 2 < fragment.size(); i++)
+		{
+			QHash<quint64, QVector<int> >::const_iterator it = postings.constFind(trigram(c + i));
+			if (it == postings.constEnd())
+				return QBitArray(size);
+
+			lists << &it.value();
+		}
+	}
+
+	//too short to narrow down, every row has to be matched
+	if (lists.isEmpty())
+		return QBitArray(size, true);
+
+	//intersect starting from the shortest posting list
+	int shortest = 0;
+	for (int i = 1; i < lists.size(); i++)
+		if (lists[i]->size() < lists[shortest]->size())
+			shortest = i;
+
+	QVector<int> result = *lists[shortest];
+	for (int i = 0; i < lists.size() && !result.isEmpty(); i++)
+	{
+		if (i == shortest)
+			continue;
+
+		const QVector<int> &list = *lists[i];
+		QVector<int> merged;
+		int j = 0, k = 0;
+		while (j < result.size() && k < list.size())
+		{
+			if (result[j] < list[k])
+				j++;
+			else if (result[j] > list[k])
+				k++;
+			else
+			{
+				merged.append(result[j]);
+				j++;
+				k++;
+			}
+		}
+		result = merged;
+	}
+
+	QBitArray bits(size);
+	foreach (int id, result)
+		bits.setBit(id);
+
+	return bits;
 }
 
 bool GameListSortFilterProxyModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
+{
+	const TreeModel *srcModel = static_cast<const TreeModel *>(sourceModel());
+	const FolderFilter &folderFilter = srcModel->folderFilter;
+
+	QModelIndex indexGameName = srcModel->index(sourceRow, COL_NAME, sourceParent);
+	const int id = static_cast<TreeItem *>(indexGameName.internalPointer())->rowId();
+
+	if (!folderFilter.contains(id))
+		return filterAcceptsGame(sourceRow, sourceParent);
+
+	// the rows of the folder are looked up once per folder switch and filter build
+	const int role = filterRole();
+	if (role != folderRole || filterText != folderText || 
+		(role == Qt::UserRole + FOLDER_EXT && filterList != folderList) ||
+		folderFilter.generation() != folderGeneration)
+	{
+		folderRole = role;
+		folderText = filterText;
+		folderList = filterList;
+		folderGeneration = folderFilter.generation();
+		folderRows = folderFilter.folderBits(role, filterText, filterList);
+	}
+
+	// the candidates are looked up once per search text and index build
+	if (!searchText.isEmpty() && (searchText != regExpSearch.pattern() ||
+		srcModel->searchIndex.generation() != searchGeneration))
+	{
+		regExpSearch = QRegExp(searchText, Qt::CaseInsensitive, QRegExp::Wildcard);
+		searchGeneration = srcModel->searchIndex.generation();
+		searchRows = srcModel->searchIndex.candidates(searchText);
+	}
+
+	bool result = acceptsRowId(srcModel, id);
+
+	//add the games to counter
+	if (result)
+		visibleGames.insert(folderFilter.gameName(id));
+
+	// a parent is kept as long as one of its clones is shown, clones may not be fetched yet
+	if (sourceParent.isValid())
+		return result;
+
+	foreach (int cloneId, srcModel->cloneRowIds(id))
+	{
+		if (acceptsRowId(srcModel, cloneId))
+		{
+			visibleGames.insert(folderFilter.gameName(cloneId));
+			result = true;
+		}
+	}
+
+	return result;
+}
+
+bool GameListSortFilterProxyModel::acceptsRowId(const TreeModel *srcModel, int id) const
+{
+	const FolderFilter &folderFilter = srcModel->folderFilter;
+	const int role = filterRole();
+
+	bool result = folderRows.testBit(id);
+
+	if (role == Qt::UserRole + FOLDER_AVAILABLE)
+		result = result && folderFilter.isAvailable(id);
+	else if (role == Qt::UserRole + FOLDER_UNAVAILABLE)
+		result = result && !folderFilter.isAvailable(id);
+
+	// apply search filter, it overrides filter flags
+	if (!searchText.isEmpty())
+	{
+		if (srcModel->searchIndex.contains(id) && !searchRows.testBit(id))
+			result = false;
+
+		// verify the candidates
+		if (result)
+		{
+			QString gameName = srcModel->displayData(id, COL_NAME).toString();
+			QString gameDesc = srcModel->displayData(id, COL_DESC).toString();
+
+			result = gameName.contains(regExpSearch)||
+					 gameDesc.contains(regExpSearch) ||
+					 utils->getDesc(gameName, false).contains(regExpSearch) ||
+					 srcModel->displayData(id, COL_MFTR).toString().contains(regExpSearch);
+		}
+	}
+	// apply filter flags
+	else
+		result = result && folderFilter.acceptsFlags(id, gameList->filterFlags);
+
+	return result;
+}
+
+// the full evaluation for rows added after the folders were indexed
+bool GameListSortFilterProxyModel::filterAcceptsGame(int sourceRow, const QModelIndex &sourceParent) const
 {
 	bool result = true;
 	QModelIndex indexGameDesc, indexGameName, index2;
@@ -3646,7 +5081,8 @@ bool GameListSortFilterProxyModel::filterAcceptsRow(int sourceRow, const QModelI
 
 		result = gameName.contains(regExpSearch)||
 				 gameDesc.contains(regExpSearch) ||
-				 utils->getDesc(gameName, false).contains(regExpSearch);
+				 utils->getDesc(gameName, false).contains(regExpSearch) ||
+				 srcModel->data(indexGameDesc.sibling(sourceRow, COL_MFTR)).toString().contains(regExpSearch);
 	}
 
 	const int role = filterRole();
@@ -3904,10 +5340,8 @@ bool GameListSortFilterProxyModel::filterAcceptsRow(int sourceRow, const QModelI
 
 bool GameListSortFilterProxyModel::lessThan(const QModelIndex &left, const QModelIndex &right) const
 {
-	const QAbstractItemModel *srcModel = sourceModel();
+	const TreeModel *srcModel = static_cast<const TreeModel *>(sourceModel());
 
-	return QString::localeAwareCompare(
-		srcModel->data(left, Qt::UserRole + SORT_STR).toString(),
-		srcModel->data(right, Qt::UserRole + SORT_STR).toString()) < 0;
+	return srcModel->sortLessThan(left, right);
 }
 
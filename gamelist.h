@@ -2,6 +2,22 @@
 #define _GAMELIST_H_
 
 #include <QtWidgets>
+
+//budget of the document cache in KB, snaps use the image cache
+#define DOC_CACHE_SIZE (4 * 1024)
+
+//budget of the shared pixmap cache in KB, holds decoded list icons
+#define ICON_CACHE_SIZE (32 * 1024)
+
+//decoded icons are kept at these sizes
+#define ICON_SIZE 32
+#define ICON_SIZE_SMALL 16
+
+//rows warmed ahead of the cursor, more when it moves fast
+#define PREFETCH_ROWS 2
+#define PREFETCH_ROWS_FAST 6
+#define PREFETCH_FAST_INTERVAL 250
+
 enum
 {
 	GAME_MISSING = 0,
@@ -77,92 +93,236 @@ enum
 	*/
 
 	FOLDER_EXT,
-	MAX_FOLDERS,
+	MAX_FOLDERS
+};
 
-	SORT_STR
+class ThumbnailStore;
+
+// what the tasks of a game read from the dat and the options, copied on the GUI thread
+class SelectionSource
+{
+public:
+	QString gameName;
+	QStringList snapLineage;	//the game and its parents by cloneof
+	QStringList docLineage;		//same for the romof of an ext rom
+	QString sourcefile;
+	bool isMessSnap;			//default snap of the last parent
+	QList<QPair<QString, QString> > regions;	//region and file name of roms, then disks
+	QHash<QString, QString> options;
 };
 
-class UpdateSelectionThread : public QThread
+// loads snaps and documents of the selected game, one pool task per visible dock
+class UpdateSelectionThread : public QObject
 {
 	Q_OBJECT
 
 public:
-	QString historyText;
-	QString mameinfoText;
-	QString driverinfoText;
-	QString storyText;
-	QString commandText;
-
-	QByteArray pmSnapData[DOCK_LAST];
-
 	UpdateSelectionThread(QObject *parent = 0);
 	~UpdateSelectionThread();
 
 	void update();
+	void prefetch(const QStringList &);
+	void clearCache();
+	void loadDock(const SelectionSource &, int, int);
+	void prefetchDock(const SelectionSource &, int, int);
+	void taskDone(int);
+	void snapImage(int, QVector<QImage> &, QImage &);
+	QString docText(int);
+	void updateThumbnails();
+
+	static QString snapArchiveName(int);
+	static QByteArray readSnap(const QString &, const QString &, int, const QString &);
 
 signals:
 	void snapUpdated(int);
 
-protected:
-	void run();
-
 private:
 	QMutex mutex;
-	QString gameName;
-	bool abort;
-
-	QString getHistory(const QString &, const QString &, int);
+	QThreadPool pool;
+	QThreadPool prefetchPool;
+	ThumbnailStore *thumbnailStore;
+	//bumped on each selection, tasks holding an older token are cancelled
+	QAtomicInt generation;
+
+	QVector<QImage> snapLevels[DOCK_LAST];
+	QImage snapFitted[DOCK_LAST];
+	QSize dockBounds[DOCK_LAST];
+	bool dockAspects[DOCK_LAST];
+	QString docTexts[DOCK_LAST - DOCK_HISTORY];
+
+	//shared by the selection and the prefetcher, keyed by type|gameName
+	QCache<QString, QString> docCache;
+
+	//prefetch starts once the tasks of the selection are done
+	int pendingTasks;
+	QList<int> visibleDocks;
+	QList<QSharedPointer<SelectionSource> > prefetchSources;
+
+	static QSharedPointer<SelectionSource> captureSource(const QString &);
+	bool isCancelled(int) const;
+	void startPrefetch(int);
+	void fetchDock(const SelectionSource &, int, int, QVector<QImage> &, QString &);
+	QString loadDoc(const SelectionSource &, int, int);
+	QString getHistory(const QString &, const SelectionSource &, int, int);
 	void convertHistory(QString &, const QString &);
-	void convertMameInfo(QString &, const QString &);
+	void convertMameInfo(QString &, const SelectionSource &);
 	void convertCommand(QString &);
-	QByteArray getScreenshot(const QString &, const QString &, int);
+	QByteArray getScreenshot(const SelectionSource &, int, int);
 };
 
 class TreeItem
 {
 public:
-	TreeItem(const QList<QVariant> &data, TreeItem *parent = 0);
+	TreeItem(int id = -1, TreeItem *parent = 0);
 	~TreeItem();
 
 	void appendChild(TreeItem *child);
+	void removeChild(int row);
 
 	TreeItem *child(int row);
 	int childCount() const;
-	int columnCount() const;
-	QVariant data(int column) const;
 	int row() const;
 	TreeItem *parent();
+	int rowId() const;
+	void setRowId(int);
 
 private:
 	QList<TreeItem*> childItems;
-	QList<QVariant> itemData;
 	TreeItem *parentItem;
+	int rowNumber;	//kept by the parent
+	int id;	//stable while the model lives, indexes the GameTable of the model
 };
 
 class GameInfo;
+class GameIcon;
+
+// the columns of all rows of the game list, indexed by row id
+class GameTable
+{
+public:
+	int append(const QString &, GameInfo *);
+	void remove(int);
+	int size() const;
+	int indexOf(const GameInfo *) const;
+
+	GameInfo *gameInfo(int) const;
+	GameInfo *gameInfo(const QString &) const;
+	const QString &string(int, int) const;
+	qint8 available(int) const;
+	void setAvailable(int, qint8);
+
+private:
+	QVector<GameInfo *> gameInfos;
+	QVector<quint32> stringIds;	//one per column
+	QVector<qint8> availables;
+	QHash<const GameInfo *, int> ids;
+	QHash<QString /*gameName*/, int> names;
+
+	//strings are interned, most manufacturers, drivers and years are shared by many rows
+	QVector<QString> strings;
+	QHash<QString, quint32> stringIndex;
+
+	quint32 intern(const QString &);
+};
+
+// membership of every row in the internal folders, switching folders only reads bitsets
+class FolderFilter
+{
+public:
+	FolderFilter();
+
+	void build(const GameTable &);
+	void setAvailable(int, bool);
+	bool contains(int) const;
+	bool isAvailable(int) const;
+	bool acceptsFlags(int, quint16) const;
+	QBitArray folderBits(int, const QString &, const QStringList &) const;
+	QString gameName(int) const;
+	int generation() const;
+
+private:
+	int size;
+	int builds;	//bits looked up from an earlier build are stale
+	QBitArray clones, extRoms, working, available, mechanical;
+	QHash<QString /*role, filterText*/, QVector<int> > postings;
+	QVector<QString> gameNames;
+	QHash<QString, int> ids;
+
+	void add(int, const QString &, int);
+	static QString postingKey(int, const QString &);
+};
+
+// trigrams of the searchable strings of every row, narrows a search before it is matched
+class SearchIndex
+{
+public:
+	SearchIndex();
+
+	void build(const GameTable &);
+	bool contains(int) const;
+	QBitArray candidates(const QString &) const;
+	int generation() const;
+
+private:
+	int size;
+	int builds;
+	QHash<quint64, QVector<int> > postings;
+
+	static quint64 trigram(const QChar *);
+};
+
 class TreeModel : public QAbstractItemModel
 {
 	Q_OBJECT
 
 public:
-	TreeModel(QObject *parent = 0);
+	TreeModel(const QList<QPair<QString, GameInfo *> > &, bool, QObject *parent = 0);
 	~TreeModel();
 
 	QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const;
 	QModelIndex index(int column, TreeItem *childItem) const;
 	QModelIndex parent(const QModelIndex &index) const;
-	QVariant displayData(GameInfo *gameInfo, int col) const;
+	QVariant displayData(int id, int col) const;
 	QVariant data(const QModelIndex &index, int role) const;
 	QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
 	int rowCount(const QModelIndex &parent = QModelIndex()) const;
 	int columnCount(const QModelIndex &parent = QModelIndex()) const;
+	bool hasChildren(const QModelIndex &parent = QModelIndex()) const;
+	bool canFetchMore(const QModelIndex &parent) const;
+	void fetchMore(const QModelIndex &parent);
+	QModelIndex gameIndex(GameInfo *, int);
+	QVector<int> cloneRowIds(int) const;
 	void updateRow(const QModelIndex &index);
+	void updateGameRows(const QList<GameInfo *> &);
+	void insertGameRows(const QStringList &gameNames);
+	void removeGameRow(GameInfo *gameInfo);
+	bool sortLessThan(const QModelIndex &, const QModelIndex &) const;
+	void invalidateSortKeys();
+	void buildSearchIndex();
+	void buildIndexes();
+	void attachItems();
+
+	FolderFilter folderFilter;
+	SearchIndex searchIndex;
 
 private:
 	TreeItem *rootItem;
+	QList<QVariant> headers;
+	GameTable gameTable;
+
+	//clones are fetched when their parent is expanded
+	bool isGrouped;
+	QHash<int /*parent*/, QVector<int> > cloneIds;
+
+	//collation ranks of every row, built lazily before the next sort
+	mutable bool sortKeysDirty;
+	mutable int rankedRows;
+	mutable QVector<quint32> sortRanks;
+	mutable quint32 romSortRanks[4];	//by audit result, from -1 to 2
+	void buildSortKeys() const;
 
 	TreeItem *getItem(const QModelIndex &index) const;
-	TreeItem *setupModelData(TreeItem *, QString);
+	TreeItem *setupModelData(TreeItem *, int);
 };
 
 class GameListTreeView : public QTreeView
@@ -184,6 +344,10 @@ public:
 
 	QSize sizeHint(const QStyleOptionViewItem &, const QModelIndex &) const;
 	void paint(QPainter *, const QStyleOptionViewItem &, const QModelIndex &) const;
+
+private:
+	QPixmap getIcon(const GameInfo *, const QString &, int, bool) const;
+	static QPixmap getResource(const QString &);
 };
 
 class Gamelist : public QObject
@@ -195,6 +359,7 @@ public:
 	QStringList xmlLines;
 	QMenu *menuContext;
 	QMenu *headerMenu;
+	QAction *actionRomUsers;
 	QString listMode;
 	QStringList intFolderNames0, intFolderNames;
 	QPixmap pmDeco;
@@ -207,6 +372,7 @@ public:
 
 	void loadIcon();
 	void disableCtrls();
+	bool isBuildingModel();
 	void restoreFolderSelection(bool = false);
 	void centerGameSelection(QModelIndex);
 	bool isAuditConsoleFolder(const QString&);
@@ -229,6 +395,10 @@ public slots:
 	void runMameFinished(int, QProcess::ExitStatus);
 	void runMergedFinished(int, QProcess::ExitStatus);
 
+	void updateGames(const QStringList &);
+	void postAudit();
+	void updateExtRoms(const QString &, const QStringList &, const QStringList &);
+
 	void filterFlagsChanged(bool);
 	void filterSearchCleared();
 	void filterSearchChanged();
@@ -238,6 +408,15 @@ private:
 	bool hasInitd;
 	QString currentTempROM;
 	QFutureWatcher<void> loadIconWatcher;
+	//the model of the next list, built in a background thread
+	QFutureWatcher<TreeModel *> buildModelWatcher;
+	QString buildListMode;
+	int buildInitMethod, pendingInitMethod;
+	//set from starting a build until its model is swapped in, the dat must not change meanwhile
+	bool isModelBuilding;
+	//ext rom rescans that arrived while building, applied to the new model
+	QHash<QString /*console*/, QPair<QStringList /*keys*/, QStringList /*descriptions*/> > pendingExtRoms;
+	QHash<QString, GameIcon *> gameIcons, loadedIcons;
 	QAbstractItemDelegate *defaultGameListDelegate;
 	// interactive threads used by the game list
 	UpdateSelectionThread selectionThread;
@@ -246,6 +425,7 @@ private:
 
 	QTimer timerJoy;
 	QTime timeJoyRepeatDelay;
+	QTime timeLastSelection;
 
 	void initFolders();
 	int parseExtFolders(const QString &);
@@ -258,6 +438,9 @@ private:
 	void addDeleteCfgMenu(const QString &, const QString &);
 	void loadMMO(int);
 	void loadIconWorkder();
+	static TreeModel *buildModel(QList<QPair<QString, GameInfo *> >, bool);
+	QString iconStamp();
+	static GameIcon *decodeIcon(const QByteArray &);
 	void openJoysticks();
 	void closeJoysticks();
 
@@ -273,7 +456,9 @@ private slots:
 	void deleteCfg();
 	void addToExtFolder();
 	void removeFromExtFolder();
+	void showRomUsers();
 	void postLoadIcon();
+	void postBuildModel();
 	void processJoyEvents();
 };
 
@@ -290,9 +475,22 @@ public:
 protected:
 	bool filterAcceptsRow(int, const QModelIndex &) const;
 	bool lessThan(const QModelIndex &, const QModelIndex &) const;
+
+private:
+	mutable int folderRole, folderGeneration;
+	mutable QString folderText;
+	mutable QStringList folderList;
+	mutable QBitArray folderRows;
+	mutable QRegExp regExpSearch;
+	mutable int searchGeneration;
+	mutable QBitArray searchRows;
+
+	bool filterAcceptsGame(int, const QModelIndex &) const;
+	bool acceptsRowId(const TreeModel *, int) const;
 };
 
 extern Gamelist *gameList;
+extern TreeModel *gameListModel;
 extern QString currentGame, currentFolder;
 extern QStringList hiddenFolders;
 extern QMap<QString, QString> consoleMap;
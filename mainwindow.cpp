@@ -15,6 +15,7 @@
 #include "dialogs.h"
 #include "ips.h"
 #include "m1.h"
+#include "gamecache.h"
 
 #ifdef USE_SDL
 #undef main
@@ -151,6 +152,9 @@ void MainWindow::logStatus(GameInfo *gameInfo)
 	statusBuffer.chop(1);
 	wStatus->setToolTip(statusBuffer);
 
+	//cache hit rates as of the last selection
+	labelGameCount->setToolTip(utils->getCacheStats());
+
 //	setText(QString("E: %1").arg(status));
 }
 
@@ -292,7 +296,9 @@ MainWindow::MainWindow(QWidget *parent) :
 	toolBar->insertAction(actionLargeIcons, actionFolderList);
 
 	romAuditor = new RomAuditor(this);
+	romWatcher = new RomWatcher(this);
 	mameAuditor = new MameExeRomAuditor(this);
+	cacheWriter = new CacheWriter(this);
 
 	pMameDat = new MameDat(0, 0);
 	gameList = new Gamelist(0);
@@ -577,7 +583,12 @@ void MainWindow::init()
 	// Auditor
 	connect(romAuditor, SIGNAL(progressSwitched(int, QString)), gameList, SLOT(switchProgress(int, QString)));
 	connect(romAuditor, SIGNAL(progressUpdated(int)), gameList, SLOT(updateProgress(int)));
-	connect(romAuditor, SIGNAL(finished()), gameList, SLOT(init()));
+	connect(romAuditor, SIGNAL(audited()), gameList, SLOT(postAudit()));
+	//audit results are persisted as soon as an audit is done
+	connect(romAuditor, SIGNAL(finished()), this, SLOT(saveCache()));
+	connect(romAuditor, SIGNAL(gamesAudited(const QStringList &)), gameList, SLOT(updateGames(const QStringList &)));
+	connect(romAuditor, SIGNAL(extRomsAudited(const QString &, const QStringList &, const QStringList &)),
+		gameList, SLOT(updateExtRoms(const QString &, const QStringList &, const QStringList &)));
 
 	// Game List
 	connect(lineEditSearch, SIGNAL(returnPressed()), gameList, SLOT(filterSearchChanged()));
@@ -1048,6 +1059,9 @@ void MainWindow::on_actionItalian_triggered()
 void MainWindow::on_actionLocalGameList_triggered()
 {
 	local_game_list = actionLocalGameList->isChecked();
+
+	if (gameListModel != NULL)
+		gameListModel->invalidateSortKeys();
 }
 
 void MainWindow::trayIconActivated(QSystemTrayIcon::ActivationReason reason)
@@ -1104,6 +1118,14 @@ void MainWindow::loadGuiSettings()
 		<< "ips_language"
 		<< "ips_relationship"
 
+		//audit
+		<< "audit_threads"
+
+		//caches
+		<< "sevenzip_cache_size"
+		<< "image_cache_size"
+		<< "thumbnail_sizes"
+
 		//ui path
 		<< "mame_binary"
 
@@ -1352,11 +1374,21 @@ void MainWindow::closeEvent(QCloseEvent *event)
 	if (!mame_binary.isEmpty())
 	{
 		saveSettings();
-		pMameDat->save();
+		//the cache is written whenever the dat changes, only a pending write is waited for
+		cacheWriter->wait();
+		utils->archiveIndex.save();
+		utils->datIndex.save();
 	}
 	event->accept();
 }
 
+// write gamelist.cache in the background
+void MainWindow::saveCache()
+{
+	if (pMameDat != NULL && !pMameDat->games.isEmpty())
+		pMameDat->save();
+}
+
 void MainWindow::setDockOptions()
 {
 	DockOptions opts = dockOptions();
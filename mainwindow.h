@@ -7,6 +7,8 @@
 
 class RomAuditor;
 class MameExeRomAuditor;
+class RomWatcher;
+class CacheWriter;
 
 class DirsUI;
 class PlayOptionsUI;
@@ -34,6 +36,8 @@ public:
 
 	RomAuditor *romAuditor;
 	MameExeRomAuditor *mameAuditor;
+	RomWatcher *romWatcher;
+	CacheWriter *cacheWriter;
 
 	GameListTreeView *tvGameList;
 	QListView *lvGameList;
@@ -122,6 +126,7 @@ public slots:
 	void setBgTile();
 	void setBgPixmap(QString = "");
 	void toggleTrayIcon(int, QProcess::ExitStatus, bool = false);
+	void saveCache();
 
 protected:
 	void resizeEvent(QResizeEvent *);
@@ -147,7 +152,9 @@ private:
 };
 
 #define MAMEPLUS_SIG 0x52111314
-#define S11N_VER 12
+#define S11N_VER 14
+//previous QDataStream based cache, still readable for migration
+#define S11N_VER_STREAM 12
 
 // global vars
 #define ZIP_EXT ".zip"
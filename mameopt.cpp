@@ -5,6 +5,7 @@
 #include "utils.h"
 #include "mainwindow.h"
 #include "dialogs.h"
+#include "audit.h"
 
 #ifdef USE_SDL
 #undef main
@@ -909,6 +910,13 @@ void OptionDelegate::setModelData(QWidget *editor, QAbstractItemModel *model,
 	{
 		bool needReload = false;
 
+		//watch the new rom dirs
+		if (optName == "rompath" || optName.endsWith("_extra_software"))
+		{
+			optUtils->chainLoadOptions(NULL, OPTLEVEL_GLOBAL, currentGame, 1);
+			win->romWatcher->watch();
+		}
+
 		if (optName == "driver_config")
 			needReload = true;
 		else if (optName == "mame_binary")
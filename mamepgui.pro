@@ -24,6 +24,7 @@ build_sdl {
 
 HEADERS += \
 	prototype.h \
+	gamecache.h \
 	mainwindow.h \
 	screenshot.h\
 	dialogs.h \
@@ -37,6 +38,7 @@ HEADERS += \
 
 SOURCES += \
 	prototype.cpp \
+	gamecache.cpp \
 	mainwindow.cpp \
 	screenshot.cpp\
 	dialogs.cpp \
@@ -1,6 +1,6 @@
-#include <QtXml>
-
+#include <QtConcurrent>
 #include "prototype.h"
+#include "gamecache.h"
 #include "mainwindow.h"
 #include "utils.h"
 #include "processmanager.h"
@@ -10,6 +10,9 @@ MameDat *pMameDat = NULL;
 MameDat *pFixDat = NULL;
 MameDat *pTempDat = NULL;
 
+//listxml output is split into shards of about this size and parsed in parallel
+#define LISTXML_SHARD_SIZE (4 * 1024 * 1024)
+
 BiosSet::BiosSet(QObject *parent) :
 	QObject(parent)
 {
@@ -65,7 +68,9 @@ GameInfo::GameInfo(QObject *parent) :
 	isHorz(true),
 	isMechanical(false),
 	isGamble(false),
-	available(GAME_MISSING)
+	available(GAME_MISSING),
+	icon(NULL),
+	pModItem(NULL)
 {
 	//	win->log("# GameInfo()");
 }
@@ -134,9 +139,29 @@ DeviceInfo * GameInfo::getDevice(QString type, int)
 }
 
 
-class XmlDatHandler : public QXmlDefaultHandler
+// wrap QXmlStreamAttributes so that the element handlers read the same as QXmlAttributes
+class XmlAttributes
+{
+public:
+	XmlAttributes(const QXmlStreamAttributes &_attributes) :
+		attributes(_attributes)
+	{
+	}
+
+	QString value(const char *qName) const
+	{
+		return attributes.value(QLatin1String(qName)).toString();
+	}
+
+private:
+	const QXmlStreamAttributes &attributes;
+};
+
+// incremental listxml parser, it can be fed with partial data as soon as it is available
+class ListXmlParser
 {
 private:
+	QXmlStreamReader reader;
 	GameInfo *gameInfo;
 	DeviceInfo *deviceInfo;
 	QString currentText;
@@ -145,14 +170,17 @@ private:
 	bool metMameTag;
 	QString mameTag;
 	int method;
+	int numGames;
 
 public:
-	XmlDatHandler(MameDat *__pMameDat, int _method)
+	ListXmlParser(MameDat *__pMameDat, int _method)
 	{
 		gameInfo = 0;
+		deviceInfo = 0;
 		_pMameDat = __pMameDat;
 		metMameTag = false;
 		method = _method;
+		numGames = 0;
 
 		if (method == 0)
 			mameTag = (isMESS ? "mess" : "mame");
@@ -160,14 +188,67 @@ public:
 			mameTag = "datafile";
 	}
 
-	bool startElement(const QString & /* namespaceURI */,
-		const QString & /* localName */,
-		const QString &qName,
-		const QXmlAttributes &attributes)
+	void addData(const QByteArray &data)
 	{
-		if (!metMameTag && qName != mameTag)
+		reader.addData(data);
+	}
+
+	int gameCount() const
+	{
+		return numGames;
+	}
+
+	bool hasError() const
+	{
+		return reader.hasError() && reader.error() != QXmlStreamReader::PrematureEndOfDocumentError;
+	}
+
+	QString errorString() const
+	{
+		return QString("%1 (line %2)").arg(reader.errorString()).arg(reader.lineNumber());
+	}
+
+	// consume all available tokens, returns false on a fatal error
+	// running out of data is not an error, parsing continues after next addData()
+	bool parse()
+	{
+		if (hasError())
 			return false;
 
+		while (!reader.atEnd())
+		{
+			switch (reader.readNext())
+			{
+			case QXmlStreamReader::StartElement:
+				startElement(reader.name().toString(), XmlAttributes(reader.attributes()));
+				break;
+
+			case QXmlStreamReader::EndElement:
+				endElement(reader.name().toString());
+				break;
+
+			case QXmlStreamReader::Characters:
+				if (!reader.isWhitespace())
+					currentText += reader.text();
+				break;
+
+			default:
+				break;
+			}
+		}
+
+		return !hasError();
+	}
+
+private:
+	void startElement(const QString &qName, const XmlAttributes &attributes)
+	{
+		if (!metMameTag && qName != mameTag)
+		{
+			reader.raiseError(QString("unexpected root element <%1>").arg(qName));
+			return;
+		}
+
 		bool ok;
 
 		if (qName == mameTag)
@@ -177,14 +258,8 @@ public:
 		}
 		else if (qName == "game" || qName == "machine")
 		{
-			//update progress
-			static int i;
-			if (method == 0)
-			{
-				gameList->updateProgress(i++);
-				qApp->processEvents();
-			}
-			
+			numGames++;
+
 			gameInfo = new GameInfo(_pMameDat);
 			gameInfo->sourcefile = attributes.value("sourcefile");
 			gameInfo->isBios = attributes.value("isbios") == "yes";
@@ -335,12 +410,9 @@ public:
 		}
 
 		currentText.clear();
-		return true;
 	}
 
-	bool endElement(const QString & /* namespaceURI */,
-		const QString & /* localName */,
-		const QString &qName)
+	void endElement(const QString &qName)
 	{
 		if (qName == "description")
 			gameInfo->description = currentText;
@@ -357,14 +429,6 @@ public:
 
 		else if (qName == "url")
 			gameInfo->url = currentText;
-
-		return true;
-	}
-
-	bool characters(const QString &str)
-	{
-		currentText += str;
-		return true;
 	}
 };
 
@@ -372,7 +436,9 @@ public:
 MameDat::MameDat(QObject *parent, int method) : 
 	QObject(parent),
 	loadProc(NULL),
-	numTotalGames(-1)
+	numTotalGames(-1),
+	metXmlRoot(false),
+	savedStamp(0)
 {
 	if (method == 0)
 		return;
@@ -386,235 +452,90 @@ MameDat::MameDat(QObject *parent, int method) :
 	connect(loadProc, SIGNAL(finished(int, QProcess::ExitStatus)), this, SLOT(loadListXmlFinished(int, QProcess::ExitStatus)));
 }
 
-MameDat::MameDat(const QByteArray &dat)
+MameDat::MameDat(const QByteArray &dat) :
+	loadProc(NULL),
+	numTotalGames(-1),
+	metXmlRoot(false),
+	savedStamp(0)
 {
-	mameOutputBuf = dat;
+	ListXmlParser parser(this, 1);
+	parser.addData(dat);
+	if (!parser.parse())
+		win->log(QString("listxml parse error: %1").arg(parser.errorString()));
 
-	parseListXml(1);
+	numTotalGames = parser.gameCount();
 }
 
 void MameDat::save()
 {
 //	win->log("start save()");
 
-	QDir().mkpath(CFG_PREFIX + "cache");
-	QFile file(CFG_PREFIX + "cache/gamelist.cache");
-	file.open(QIODevice::WriteOnly);
-	QDataStream out(&file);
-
-	out << (quint32)MAMEPLUS_SIG; //mameplus signature
-	out << (qint16)S11N_VER; //s11n version
-	out.setVersion(QDataStream::Qt_4_6);
-	out << mameVersion;
-	out << defaultIni;	//default.ini
-	out << games.size();
+	//taking the snapshot is cheap, encoding and writing it are done by the writer
+	CacheSnapshot snapshot(this);
+	quint64 stamp = snapshot.stamp();
+	if (stamp == savedStamp)
+		return;
+	savedStamp = stamp;
 
 	win->log(QString("s11n %1 games").arg(games.size()));
 
-	gameList->switchProgress(numTotalGames, tr("Saving listxml"));
-	int i = 0;
-	foreach (QString gameName, games.keys())
-	{
-		gameList->updateProgress(i++);
-		qApp->processEvents();
-	
-		GameInfo *gameInfo = games[gameName];
-		out << gameName;
-
-		/* internal */
-		out << gameInfo->isExtRom;
-		out << gameInfo->available;
-		out << gameInfo->extraInfo;
-
-		/* game */
-		out << gameInfo->romof;
-		out << gameInfo->description;
-		out << gameInfo->year;
-		out << gameInfo->manufacturer;
-		if (!gameInfo->isExtRom)
-		{
-			out << gameInfo->cloneof;
-			out << gameInfo->sourcefile;
-			out << gameInfo->isBios;
-			out << gameInfo->isDevice;
-			out << gameInfo->sampleof;
-			out << gameInfo->isMechanical;
-			out << gameInfo->isGamble;
-		}
-
-		/* biosset */
-		if (!gameInfo->isExtRom)
-		{
-			out << gameInfo->biosSets.size();
-			foreach (QString name, gameInfo->biosSets.keys())
-			{
-				BiosSet *biosSet = gameInfo->biosSets[name];
-				out << name;
-				out << biosSet->description;
-				out << biosSet->isDefault;
-			}
-		}
-
-		/* rom */
-		out << gameInfo->roms.size();
-		foreach (quint32 crc, gameInfo->roms.keys())
-		{
-			RomInfo *romInfo = gameInfo->roms.value(crc);
-			out << crc;
-			out << romInfo->name;
-			out << romInfo->size;
-			out << romInfo->status;
-			if (!gameInfo->isExtRom)
-			{
-				out << romInfo->bios;
-				out << romInfo->merge;
-				out << romInfo->region;
-			}
-		}
-
-		if (!gameInfo->isExtRom)
-		{
-			/* disk */
-			out << gameInfo->disks.size();
-			foreach (QString sha1, gameInfo->disks.keys())
-			{
-				DiskInfo *diskInfo = gameInfo->disks[sha1];
-				out << sha1;
-				out << diskInfo->name;
-				out << diskInfo->merge;
-				out << diskInfo->region;
-				out << diskInfo->index;
-				out << diskInfo->status;
-			}
-
-			/* sample */
-			out << gameInfo->samples;
-
-			/* chip */
-			out << gameInfo->chips.size();
-			foreach (ChipInfo* chipInfo, gameInfo->chips)
-			{
-				out << chipInfo->name;
-				out << chipInfo->tag;
-				out << chipInfo->type;
-				out << chipInfo->clock;
-			}
-
-			/* softwarelist */
-			out << gameInfo->softwarelists.size();
-			foreach (SoftwareListInfo* softwarelist, gameInfo->softwarelists)
-			{
-				out << softwarelist->name;
-				out << softwarelist->status;
-				out << softwarelist->filter;
-			}
-
-			/* display */
-			out << gameInfo->displays.size();
-			foreach (DisplayInfo* displayInfo, gameInfo->displays)
-			{
-				out << displayInfo->type;
-				out << displayInfo->rotate;
-				out << displayInfo->flipx;
-				out << displayInfo->width;
-				out << displayInfo->height;
-				out << displayInfo->refresh;
-				out << displayInfo->htotal;
-				out << displayInfo->hbend;
-				out << displayInfo->hbstart;
-				out << displayInfo->vtotal;
-				out << displayInfo->vbend;
-				out << displayInfo->vbstart;
-			}
-
-			/* sound */
-			out << gameInfo->channels;
+	QDir().mkpath(CFG_PREFIX + "cache");
+	win->cacheWriter->write(CFG_PREFIX + "cache/gamelist.cache", snapshot);
+}
 
-			/* input */
-			out << gameInfo->service;
-			out << gameInfo->tilt;
-			out << gameInfo->players;
-			out << gameInfo->buttons;
-			out << gameInfo->coins;
-
-			out << gameInfo->controls.size();
-			foreach (ControlInfo* controlInfo, gameInfo->controls)
-			{
-				out << controlInfo->type;
-				out << controlInfo->minimum;
-				out << controlInfo->maximum;
-				out << controlInfo->sensitivity;
-				out << controlInfo->keydelta;
-				out << controlInfo->reverse;
-			}
+int MameDat::load()
+{
+	const QString cacheFileName = CFG_PREFIX + "cache/gamelist.cache";
+	if (!QFile::exists(cacheFileName))
+	{
+		win->log(tr("No game list cache found. A full refresh is required."));
+		return QDataStream::ReadCorruptData;
+	}
 
-			/* driver */	
-			out << gameInfo->status;
-			out << gameInfo->emulation;
-			out << gameInfo->color;
-			out << gameInfo->sound;
-			out << gameInfo->graphic;
-			out << gameInfo->cocktail;
-			out << gameInfo->protection;
-			out << gameInfo->savestate;
-			out << gameInfo->palettesize;
-		}
+	GameCache cache;
+	int streamVersion = cache.open(cacheFileName);
 
-		/* device */
-		bool needSaveDevices = gameInfo->isExtRom ? false : true;
-		foreach (DeviceInfo *deviceInfo, gameInfo->devices)
-		{
-			if (!deviceInfo->mountedPath.isEmpty() && !deviceInfo->isConst)
-			{
-				needSaveDevices = true;
-				break;
-			}	
-		}
+	// migrate caches written in the previous stream format
+	if (streamVersion == S11N_VER_STREAM)
+	{
+		cache.close();
+		int status = loadStream();
 
-		//hack the devices.size() so that we dont save extroms and only const dev in mountedPath
-		int deviceSize = 0;
-		if (needSaveDevices)
-			deviceSize = gameInfo->devices.size();
+		//rewrite it in the current format
+		if (status == QDataStream::Ok)
+			save();
+		return status;
+	}
 
-		out << deviceSize;
+	if (streamVersion != S11N_VER)
+	{
+		win->log(tr("Cache streamVersion has been updated. A full refresh is required."));
+		return QDataStream::ReadCorruptData;
+	}
 
-		if (needSaveDevices)
-		{
-			QMapIterator<QString, DeviceInfo *> it(gameInfo->devices);
-			while (it.hasNext())
-			{
-				it.next();
-				out << it.key();
-				DeviceInfo *deviceInfo = it.value();
+	int status = cache.load(this);
+	cache.close();
 
-				if (!gameInfo->isExtRom)
-				{
-					out << deviceInfo->type;
-					out << deviceInfo->tag;
-					out << deviceInfo->mandatory;
-					out << deviceInfo->extensionNames;
-				}
+	//an unchanged dat is not written again
+	if (status == QDataStream::Ok)
+		savedStamp = CacheSnapshot(this).stamp();
 
-				QString mountedPath = deviceInfo->mountedPath;
-				if (deviceInfo->isConst)
-					mountedPath.clear();
-				out << mountedPath;
-			}
-		}
+	win->log(QString("loaded %1 games from cache.").arg(games.size()));
 
-		/*ramoption */
-		if (!gameInfo->isExtRom)
-		{
-			out << gameInfo->ramOptions;
-			out << gameInfo->defaultRamOption;
-		}
+	// verify MAME Version
+	QString mameVersion0 = mameVersion;
+	mameVersion = utils->getMameVersion();
+	if (mameVersion != mameVersion0)
+	{
+		win-> log(QString("new MAME version: %1 vs %2").arg(mameVersion0).arg(mameVersion));
+		return QDataStream::ReadCorruptData;
 	}
-	gameList->switchProgress(-1, "");
-	
-	file.close();
+
+	return completeData() | status;
 }
 
-int MameDat::load()
+// read a cache in the previous QDataStream format
+int MameDat::loadStream()
 {
 	QFile file(CFG_PREFIX + "cache/gamelist.cache");
 	file.open(QIODevice::ReadOnly);
@@ -632,7 +553,7 @@ int MameDat::load()
 	// Read the version
 	qint16 streamVersion;
 	in >> streamVersion;
-	if (streamVersion != S11N_VER)
+	if (streamVersion != S11N_VER_STREAM)
 	{
 		win->log(tr("Cache streamVersion has been updated. A full refresh is required."));
 		return QDataStream::ReadCorruptData;
@@ -855,86 +776,189 @@ int MameDat::load()
 	return completeData() | in.status();
 }
 
-void MameDat::parseListXml(int method)
+// find a machine start tag, older versions use <game>
+static int indexOfGameTag(const QByteArray &buf, bool last)
 {
-	XmlDatHandler handler(this, method);
-	QXmlSimpleReader reader;
-	reader.setContentHandler(&handler);
-	reader.setErrorHandler(&handler);
+	int pos1, pos2;
+
+	if (last)
+		return qMax(buf.lastIndexOf("<machine "), buf.lastIndexOf("<game "));
 
-	QXmlInputSource *pXmlInputSource = new QXmlInputSource();
-	pXmlInputSource->setData(mameOutputBuf);
+	pos1 = buf.indexOf("<machine ");
+	pos2 = buf.indexOf("<game ");
+	if (pos1 < 0 || (pos2 >= 0 && pos2 < pos1))
+		return pos2;
+	return pos1;
+}
 
-//	win->log("DEBUG: Gamelist::start parseListXml()");
+// cut the pending listxml output at a machine boundary and parse it in a worker thread
+void MameDat::dispatchListXml(bool flush)
+{
+	// skip the preamble, only the build attribute of the root element is needed
+	if (!metXmlRoot)
+	{
+		int pos = indexOfGameTag(pendingXml, false);
+		if (pos < 0)
+		{
+			if (flush)
+				pendingXml.clear();
+			return;
+		}
 
-	if (method == 0)
-		gameList->switchProgress(numTotalGames, tr("Parsing listxml"));
-	
-	reader.parse(*pXmlInputSource);
+		QRegExp rxBuild("build=\"([^\"]*)\"");
+		if (rxBuild.indexIn(QString::fromUtf8(pendingXml.left(pos))) >= 0)
+			mameVersion = rxBuild.cap(1);
 
-	if (method == 0)
+		pendingXml.remove(0, pos);
+		metXmlRoot = true;
+	}
+
+	if (flush)
+	{
+		// strip the closing root element
+		int pos = pendingXml.lastIndexOf("</");
+		if (pos >= 0)
+			pendingXml.truncate(pos);
+	}
+	else
+	{
+		if (pendingXml.size() < LISTXML_SHARD_SIZE)
+			return;
+
+		// keep the last, possibly incomplete, machine for the next shard
+		int pos = indexOfGameTag(pendingXml, true);
+		if (pos <= 0)
+			return;
+
+		xmlShards << QtConcurrent::run(this, &MameDat::parseListXmlShard, pendingXml.left(pos));
+		pendingXml.remove(0, pos);
+		return;
+	}
+
+	if (!pendingXml.trimmed().isEmpty())
+		xmlShards << QtConcurrent::run(this, &MameDat::parseListXmlShard, pendingXml);
+	pendingXml.clear();
+}
+
+// runs in a worker thread, the shard is parsed into a standalone table
+MameDat *MameDat::parseListXmlShard(const QByteArray &shard)
+{
+	MameDat *shardDat = new MameDat();
+	QByteArray mameTag = isMESS ? "mess" : "mame";
+
+	ListXmlParser parser(shardDat, 0);
+	parser.addData("<" + mameTag + ">");
+	parser.addData(shard);
+	parser.addData("</" + mameTag + ">");
+	if (!parser.parse())
+		win->log(QString("listxml parse error: %1").arg(parser.errorString()));
+
+	// hand over the table with all its children to the GUI thread for merging
+	shardDat->moveToThread(qApp->thread());
+	return shardDat;
+}
+
+// move parsed games into this table, wait for pending shards if needed
+void MameDat::mergeListXmlShards(bool wait)
+{
+	const int numShards = xmlShards.size();
+	int i = 0;
+
+	//the final wait can take seconds, show the shards being merged
+	if (wait && numShards > 0)
+		gameList->switchProgress(numShards, tr("Parsing listxml"));
+
+	while (!xmlShards.isEmpty())
+	{
+		if (!wait && !xmlShards.first().isFinished())
+			break;
+
+		MameDat *shardDat = xmlShards.takeFirst().result();
+
+		QHashIterator<QString, GameInfo *> it(shardDat->games);
+		while (it.hasNext())
+		{
+			it.next();
+			it.value()->setParent(this);
+			games[it.key()] = it.value();
+		}
+
+		delete shardDat;
+
+		if (wait)
+		{
+			gameList->updateProgress(++i);
+			qApp->processEvents();
+		}
+	}
+
+	if (wait && numShards > 0)
 		gameList->switchProgress(-1, "");
+}
 
-	if (method == 0)
+// post process a freshly parsed listxml
+void MameDat::completeListXml()
+{
+	//the roms have changed, completeData() builds the index again
+	romIndex.clear();
+
+	GameInfo *_gameInfo, *gameInfo0;
+	bool noAutoAudit = false;
+
+	// restore previous audit results and other info
+	foreach (QString gameName, games.keys())
 	{
-		GameInfo *_gameInfo, *gameInfo0;
-		bool noAutoAudit = false;
+		_gameInfo = games[gameName];
 
-		// restore previous audit results and other info
-		foreach (QString gameName, games.keys())
+		if (pTempDat != NULL && pTempDat->games.contains(gameName))
 		{
-			_gameInfo = games[gameName];
+			gameInfo0 = pTempDat->games[gameName];
 
-			if (pTempDat != NULL && pTempDat->games.contains(gameName))
-			{
-				gameInfo0 = pTempDat->games[gameName];
-
-				//if successfully loaded results, dont auto refresh game list
-				_gameInfo->available = gameInfo0->available;
-				if (_gameInfo->available == GAME_COMPLETE)
-					noAutoAudit = true;
-				
-				if (!gameInfo0->icondata.isEmpty())
-					_gameInfo->icondata = gameInfo0->icondata;
-				if (!gameInfo0->lcDesc.isEmpty())
-					_gameInfo->lcDesc = gameInfo0->lcDesc;
-				if (!gameInfo0->lcMftr.isEmpty())
-					_gameInfo->lcMftr = gameInfo0->lcMftr;
-			}
+			//if successfully loaded results, dont auto refresh game list
+			_gameInfo->available = gameInfo0->available;
+			if (_gameInfo->available == GAME_COMPLETE)
+				noAutoAudit = true;
+			
+			if (gameInfo0->icon != NULL)
+				_gameInfo->icon = gameInfo0->icon;
+			if (!gameInfo0->lcDesc.isEmpty())
+				_gameInfo->lcDesc = gameInfo0->lcDesc;
+			if (!gameInfo0->lcMftr.isEmpty())
+				_gameInfo->lcMftr = gameInfo0->lcMftr;
 		}
+	}
 
-		gameList->autoAudit = !noAutoAudit;
+	gameList->autoAudit = !noAutoAudit;
 
-		completeData();
+	completeData();
 
-		// restore previous audit results for ext roms
-		if (pTempDat != NULL)
+	// restore previous audit results for ext roms
+	if (pTempDat != NULL)
+	{
+		foreach (QString gameName, pTempDat->games.keys())
 		{
-			foreach (QString gameName, pTempDat->games.keys())
-			{
-				gameInfo0 = pTempDat->games[gameName];
+			gameInfo0 = pTempDat->games[gameName];
 
-				if (gameInfo0->isExtRom && 
-					//the console is supported by current mame version
-					games.contains(gameInfo0->romof))
-				{
-					_gameInfo = new GameInfo(this);
-					_gameInfo->description = gameInfo0->description;
-					_gameInfo->isExtRom = true;
-					_gameInfo->romof = gameInfo0->romof;
-					_gameInfo->sourcefile = gameInfo0->sourcefile;
-					_gameInfo->available = GAME_COMPLETE;
-					games[gameName] = _gameInfo;
-				}
+			if (gameInfo0->isExtRom && 
+				//the console is supported by current mame version
+				games.contains(gameInfo0->romof))
+			{
+				_gameInfo = new GameInfo(this);
+				_gameInfo->description = gameInfo0->description;
+				_gameInfo->isExtRom = true;
+				_gameInfo->romof = gameInfo0->romof;
+				_gameInfo->sourcefile = gameInfo0->sourcefile;
+				_gameInfo->available = GAME_COMPLETE;
+				_gameInfo->icon = gameInfo0->icon;
+				games[gameName] = _gameInfo;
 			}
-			
-			delete pTempDat;
-			pTempDat = NULL;
 		}
+		
+		//the writer may still encode the previous dat
+		win->cacheWriter->wait();
+		delete pTempDat;
+		pTempDat = NULL;
 	}
-	
-	delete pXmlInputSource;
-	mameOutputBuf.clear();
 }
 
 int MameDat::completeData()
@@ -973,22 +997,105 @@ int MameDat::completeData()
 			_gameInfo->isHorz = false;
 	}
 
+	if (romIndex.isEmpty())
+		buildRomIndex();
+
 	return QDataStream::Ok;
 }
 
+static void addRomSlot(QVector<RomSlot> &slots, QList<GameInfo *> &suppliers, 
+	GameInfo *supplier, RomInfo *romInfo, const QString &gameName, bool isDirect)
+{
+	if (supplier == NULL || suppliers.contains(supplier))
+		return;
+
+	RomSlot slot;
+	slot.supplier = supplier;
+	slot.romInfo = romInfo;
+	slot.gameName = gameName;
+	slot.isDirect = isDirect;
+
+	suppliers.append(supplier);
+	slots.append(slot);
+}
+
+// map each crc to the roms it satisfies and the archives that can supply them
+void MameDat::buildRomIndex()
+{
+	romIndex.clear();
+
+	QHashIterator<QString, GameInfo *> it(games);
+	while (it.hasNext())
+	{
+		it.next();
+		GameInfo *gameInfo = it.value();
+
+		//fixme: skip auditing for consoles
+		if (gameInfo->isExtRom)
+			continue;
+
+		GameInfo *cloneofInfo = games.value(gameInfo->cloneof);
+		GameInfo *romofInfo = games.value(gameInfo->romof);
+		GameInfo *biosInfo = NULL;
+		if (romofInfo != NULL)
+			biosInfo = games.value(romofInfo->romof);
+
+		//a crc can be listed more than once by a game, each entry gets its own slots
+		foreach (quint32 crc, gameInfo->roms.uniqueKeys())
+		{
+			QVector<RomSlot> &slots = romIndex[crc];
+
+			foreach (RomInfo *romInfo, gameInfo->roms.values(crc))
+			{
+				QList<GameInfo *> suppliers;
+
+				//the archive of the game or its parent
+				addRomSlot(slots, suppliers, gameInfo, romInfo, it.key(), true);
+				addRomSlot(slots, suppliers, cloneofInfo, romInfo, it.key(), true);
+
+				//romof parent and bios, when they have the rom
+				if (romofInfo != NULL && romofInfo->roms.contains(crc))
+				{
+					addRomSlot(slots, suppliers, romofInfo, romInfo, it.key(), false);
+					addRomSlot(slots, suppliers, games.value(romofInfo->cloneof), romInfo, it.key(), false);
+				}
+
+				if (biosInfo != NULL && biosInfo->roms.contains(crc))
+				{
+					addRomSlot(slots, suppliers, biosInfo, romInfo, it.key(), false);
+					addRomSlot(slots, suppliers, games.value(biosInfo->cloneof), romInfo, it.key(), false);
+				}
+			}
+		}
+	}
+}
+
+// names of all games that use a rom
+QStringList MameDat::gamesUsingRom(quint32 crc, quint64 size)
+{
+	QStringList gameNames;
+
+	if (romIndex.isEmpty())
+		buildRomIndex();
+
+	foreach (const RomSlot &slot, romIndex.value(crc))
+	{
+		if (slot.romInfo->size == size && !gameNames.contains(slot.gameName))
+			gameNames << slot.gameName;
+	}
+
+	return gameNames;
+}
+
 void MameDat::loadListXmlReadyReadStandardOutput()
 {
 	QProcess *proc = (QProcess *)sender();
-	QString buf = proc->readAllStandardOutput();
-	
-	//mamep: remove windows endl
-	buf.replace("\r", "");
-	//FIXME
-	buf.replace("\n", "");
-	buf.replace("\t", "");
 
-	numTotalGames += buf.count("<machine name=");
-	mameOutputBuf += buf.toUtf8();
+	pendingXml.append(proc->readAllStandardOutput());
+	dispatchListXml(false);
+	mergeListXmlShards(false);
+
+	numTotalGames = games.size();
 
 	win->logStatus(QString(tr("Loading listxml: %1 games")).arg(numTotalGames));
 }
@@ -998,7 +1105,15 @@ void MameDat::loadListXmlFinished(int, QProcess::ExitStatus)
 	QProcess *proc = (QProcess *)sender();
 	procMan->procMap.remove(proc);
 
-	parseListXml();
+	//drain remaining output and wait for all shards
+	pendingXml.append(proc->readAllStandardOutput());
+	dispatchListXml(true);
+	mergeListXmlShards(true);
+
+	numTotalGames = games.size();
+	metXmlRoot = false;
+
+	completeListXml();
 
 	QStringList args;
 	args << "-showconfig" << "-noreadconfig";
@@ -1022,6 +1137,10 @@ void MameDat::loadDefaultIniFinished(int, QProcess::ExitStatus)
 {
 	QProcess *proc = (QProcess *)sender();
 	procMan->procMap.remove(proc);
+
+	//the dat is rebuilt from listxml and mame.ini, persist it in the background
+	save();
+
 	//fixme move to a better place
 	win->setVersion();
 }
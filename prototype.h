@@ -120,6 +120,14 @@ public:
 	SoftwareListInfo(QObject *parent = 0);
 };
 
+// decoded icon, shared by a game, its clones and ext roms
+class GameIcon
+{
+public:
+	QImage image;	//premultiplied, at most 32px
+	QImage image16;	//premultiplied, 16px
+};
+
 class TreeItem;
 class GameInfo : public QObject
 {
@@ -209,7 +217,7 @@ public:
 	bool isGamble;
 
 	qint8 available;
-	QByteArray icondata;
+	GameIcon *icon;	//owned by the game list
 	TreeItem *pModItem;
 	QSet<QString> clones;
 
@@ -221,6 +229,16 @@ public:
 	QString getDeviceInstanceName(QString type, int = 0);
 };
 
+// a rom of a game and an archive (by game) that can supply it
+class RomSlot
+{
+public:
+	GameInfo *supplier;
+	RomInfo *romInfo;
+	QString gameName;
+	bool isDirect;	//supplied by the game itself or its cloneof, otherwise by romof or bios
+};
+
 class MameDat : public QObject
 {
 Q_OBJECT
@@ -229,19 +247,31 @@ public:
 	QString defaultIni;
 	QString mameVersion;
 	QHash<QString, GameInfo *> games;
+	QHash<quint32 /*crc*/, QVector<RomSlot> > romIndex;
+	//strings loaded from gamelist.cache, shared by all games using them
+	QHash<quint32 /*offset*/, QString> cacheStrings;
 
 	MameDat(QObject * = 0, int = 0);
 	MameDat(const QByteArray&);
 	int load();
 	void save();
 	int completeData();
+	void buildRomIndex();
+	QStringList gamesUsingRom(quint32, quint64);
 
 private:
 	QProcess *loadProc;
 	int numTotalGames;
-	QByteArray mameOutputBuf;
-
-	void parseListXml(int = 0);
+	bool metXmlRoot;
+	QByteArray pendingXml;
+	QList<QFuture<MameDat *> > xmlShards;
+	quint64 savedStamp;	//of the state last saved or loaded
+
+	int loadStream();
+	void dispatchListXml(bool);
+	MameDat *parseListXmlShard(const QByteArray &);
+	void mergeListXmlShards(bool);
+	void completeListXml();
 
 private slots:
 	// external process management
@@ -1,7 +1,10 @@
 // screenshot widget
+#include <QSaveFile>
 #include "screenshot.h"
 #include "utils.h"
 #include "mainwindow.h"
+#include "gamelist.h"
+#include "mameopt.h"
 
 Screenshot::Screenshot(QString title, QWidget *parent) : 
 	QDockWidget(parent),
@@ -33,29 +36,74 @@ Screenshot::Screenshot(QString title, QWidget *parent) :
 
 void Screenshot::resizeEvent(QResizeEvent * /* event */)
 {
-    QSize scaledSize = originalPixmap.size();
-	scaledSize.scale(screenshotLabel->size(), Qt::KeepAspectRatio);
-
+	//rescaled from the nearest mip level
 	updateScreenshotLabel();
 }
 
 void Screenshot::setPixmap(QPixmap pm)
 {
-	originalPixmap = pm;
+	mipLevels = buildMipChain(pm.toImage());
+	fittedImage = QImage();
 	forceAspect = false;
 	updateScreenshotLabel();
 }
 
 void Screenshot::setPixmap(const QByteArray &pmdata, bool _forceAspect)
 {
-	QPixmap pm;
-	pm.loadFromData(pmdata);
-	originalPixmap = pm;
+	QImage image;
+	image.loadFromData(pmdata);
+	mipLevels = buildMipChain(image);
+	fittedImage = QImage();
 
 	forceAspect = _forceAspect;
 	updateScreenshotLabel();
 }
 
+// show an image decoded and scaled off the GUI thread
+void Screenshot::setImage(const QVector<QImage> &levels, const QImage &fitted, bool _forceAspect)
+{
+	mipLevels = levels;
+	fittedImage = fitted;
+
+	forceAspect = _forceAspect;
+	updateScreenshotLabel();
+}
+
+QSize Screenshot::boundingSize() const
+{
+	return screenshotLabel->size();
+}
+
+// halve the image until it reaches MIP_MIN_SIZE, safe to call in any thread
+QVector<QImage> Screenshot::buildMipChain(const QImage &image)
+{
+	QVector<QImage> levels;
+	if (image.isNull())
+		return levels;
+
+	levels << image;
+	while (levels.last().width() / 2 >= MIP_MIN_SIZE && levels.last().height() / 2 >= MIP_MIN_SIZE)
+		levels << levels.last().scaled(levels.last().size() / 2, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+	return levels;
+}
+
+// scale from the smallest level that is not smaller than the target, safe to call in any thread
+QImage Screenshot::scaleMipChain(const QVector<QImage> &levels, const QSize &size)
+{
+	if (levels.isEmpty() || size.isEmpty())
+		return QImage();
+
+	int i = levels.size() - 1;
+	while (i > 0 && (levels[i].width() < size.width() || levels[i].height() < size.height()))
+		i--;
+
+	if (levels[i].size() == size)
+		return levels[i];
+
+	return levels[i].scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
 //click screenshot area to rotate dockwidgets
 void Screenshot::rotateImage()
 {
@@ -92,13 +140,17 @@ void Screenshot::rotateImage()
 
 void Screenshot::updateScreenshotLabel(bool isLoading)
 {
-	if (originalPixmap.isNull())
+	if (mipLevels.isEmpty())
 		return;
 
-    QSize scaledSize = utils->getScaledSize(originalPixmap.size(), screenshotLabel->size(), forceAspect);
+    QSize scaledSize = utils->getScaledSize(mipLevels.first().size(), screenshotLabel->size(), forceAspect);
 
 	screenshotLabel->setIconSize(scaledSize);
-	QPixmap pm = originalPixmap.scaled(scaledSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+
+	//the loader has usually scaled it already
+	if (fittedImage.size() != scaledSize)
+		fittedImage = scaleMipChain(mipLevels, scaledSize);
+	QPixmap pm = QPixmap::fromImage(fittedImage);
 
 	if (isLoading)
 	{
@@ -113,3 +165,323 @@ void Screenshot::updateScreenshotLabel(bool isLoading)
 	
 	screenshotLabel->setIcon(pm);
 }
+
+ThumbnailStore::ThumbnailStore(QObject *parent) :
+	QThread(parent),
+	abort(false)
+{
+	//longest sides in pixels, none disables thumbnails
+	QStringList sizes = pGuiSettings->value("thumbnail_sizes", "160;240;360;480").toString().split(";");
+	foreach (QString size, sizes)
+		if (size.toInt() > 0 && !thumbSizes.contains(size.toInt()))
+			thumbSizes << size.toInt();
+	qSort(thumbSizes);
+}
+
+ThumbnailStore::~ThumbnailStore()
+{
+	abort = true;
+	wait();
+	qDeleteAll(packs);
+}
+
+// open current packs and rebuild stale ones in the background, a build of other sources is restarted
+void ThumbnailStore::update(const QStringList &_gameNames)
+{
+	if (thumbSizes.isEmpty())
+		return;
+
+	QHash<int, QString> stale;
+	for (int snapType = DOCK_SNAP; snapType <= DOCK_PCB; snapType ++)
+	{
+		QString stamp = sourceStamp(snapType);
+		if (stamp.isEmpty())
+			continue;
+
+		mutex.lock();
+		bool isCurrent = packs.contains(snapType) && packs[snapType]->stamp == stamp;
+		mutex.unlock();
+
+		if (isCurrent)
+			continue;
+
+		//already being rebuilt from the same sources
+		if (isRunning() && staleStamps.value(snapType) == stamp)
+		{
+			stale[snapType] = stamp;
+			continue;
+		}
+
+		if (open(snapType, stamp))
+			continue;
+
+		//serve originals until it is rebuilt
+		mutex.lock();
+		delete packs.take(snapType);
+		mutex.unlock();
+
+		stale[snapType] = stamp;
+	}
+
+	if (isRunning())
+	{
+		//the running build covers it
+		bool isCovered = _gameNames == gameNames;
+		foreach (int snapType, stale.keys())
+			if (staleStamps.value(snapType) != stale[snapType])
+				isCovered = false;
+
+		if (isCovered)
+			return;
+
+		abort = true;
+		wait();
+
+		//packs finished meanwhile are current
+		mutex.lock();
+		foreach (int snapType, stale.keys())
+			if (packs.contains(snapType) && packs[snapType]->stamp == stale[snapType])
+				stale.remove(snapType);
+		mutex.unlock();
+	}
+
+	if (stale.isEmpty())
+		return;
+
+	staleStamps = stale;
+
+	//the builder does not read the options
+	sourcePaths.clear();
+	foreach (int snapType, staleStamps.keys())
+		sourcePaths[snapType] = mameOpts.value(validGuiSettings[snapType])->globalvalue;
+	MameOption *snapNameOpt = mameOpts.value("snapname");
+	snapName = snapNameOpt != NULL ? snapNameOpt->currvalue : QString();
+
+	gameNames = _gameNames;
+	abort = false;
+	start(LowestPriority);
+}
+
+// smallest thumbnail size that fills a dock without enlarging it, 0 if there is none
+int ThumbnailStore::sizeFor(const QSize &size) const
+{
+	foreach (int thumbSize, thumbSizes)
+		if (size.width() <= thumbSize && size.height() <= thumbSize)
+			return thumbSize;
+
+	return 0;
+}
+
+bool ThumbnailStore::find(int snapType, const QString &gameName, int thumbSize, QImage &image)
+{
+	int sizeIndex = thumbSizes.indexOf(thumbSize);
+	QByteArray record;
+
+	{
+		QMutexLocker locker(&mutex);
+
+		ThumbnailPack *pack = packs.value(snapType);
+		if (sizeIndex < 0 || pack == NULL || !pack->index.contains(gameName))
+			return false;
+
+		ThumbnailRange range = pack->index[gameName].value(sizeIndex);
+		if (range.second <= 0)
+			return false;
+
+		record = QByteArray((const char *)pack->map + range.first, range.second);
+	}
+
+	//raw pixels, only inflated
+	QDataStream in(record);
+	in.setVersion(QDataStream::Qt_4_6);
+
+	qint32 width, height, format;
+	QByteArray bits;
+	in >> width;
+	in >> height;
+	in >> format;
+	in >> bits;
+	if (in.status() != QDataStream::Ok)
+		return false;
+
+	bits = qUncompress(bits);
+	QImage thumb(width, height, (QImage::Format)format);
+	if (thumb.isNull() || bits.size() != thumb.byteCount())
+		return false;
+
+	memcpy(thumb.bits(), bits.constData(), bits.size());
+	image = thumb;
+	return true;
+}
+
+void ThumbnailStore::run()
+{
+	foreach (int snapType, staleStamps.keys())
+	{
+		if (abort)
+			break;
+
+		QTime time;
+		time.start();
+
+		if (build(snapType, staleStamps[snapType]) && open(snapType, staleStamps[snapType]))
+			win->log(QString("thumbnails: %1 packed in %2s")
+				.arg(UpdateSelectionThread::snapArchiveName(snapType)).arg(time.elapsed() / 1000));
+	}
+}
+
+QString ThumbnailStore::packPath(int snapType) const
+{
+	return CFG_PREFIX + "cache/" + UpdateSelectionThread::snapArchiveName(snapType) + ".thumbs";
+}
+
+// size and mtime of every archive and folder the snaps of a type come from
+QString ThumbnailStore::sourceStamp(int snapType) const
+{
+	QString stamp;
+	QString zipName = UpdateSelectionThread::snapArchiveName(snapType);
+	QStringList dirPaths = mameOpts[validGuiSettings[snapType]]->globalvalue.split(";");
+
+	foreach (QString dirPath, dirPaths)
+	{
+		if (dirPath.isEmpty())
+			continue;
+
+		dirPath = utils->getPath(dirPath);
+
+		QStringList sources;
+		sources << dirPath + zipName + ZIP_EXT << dirPath + zipName + SZIP_EXT << dirPath + zipName << dirPath;
+		foreach (QString source, sources)
+		{
+			QFileInfo fileInfo(source);
+			if (fileInfo.exists())
+				stamp += QString("%1:%2:%3;").arg(source).arg(fileInfo.size())
+					.arg(fileInfo.lastModified().toMSecsSinceEpoch());
+		}
+	}
+
+	return stamp;
+}
+
+// map a pack if it was built from the same sources
+bool ThumbnailStore::open(int snapType, const QString &stamp)
+{
+	ThumbnailPack *pack = new ThumbnailPack();
+	pack->file.setFileName(packPath(snapType));
+	pack->map = NULL;
+
+	if (pack->file.open(QIODevice::ReadOnly))
+	{
+		QDataStream in(&pack->file);
+		in.setVersion(QDataStream::Qt_4_6);
+
+		quint32 mamepSig;
+		qint16 packVersion;
+		QList<int> packThumbSizes;
+		qint64 indexOffset = 0;
+
+		in >> mamepSig;
+		in >> packVersion;
+
+		//the rest of the header is laid out by the version
+		if (mamepSig == MAMEPLUS_SIG && packVersion == THUMB_PACK_VER)
+		{
+			in >> pack->stamp;
+			in >> packThumbSizes;
+			in >> indexOffset;
+		}
+
+		if (in.status() == QDataStream::Ok && packVersion == THUMB_PACK_VER && 
+			pack->stamp == stamp && packThumbSizes == thumbSizes && pack->file.seek(indexOffset))
+		{
+			in >> pack->index;
+			if (in.status() == QDataStream::Ok)
+				pack->map = pack->file.map(0, pack->file.size());
+		}
+	}
+
+	if (pack->map == NULL)
+	{
+		delete pack;
+		return false;
+	}
+
+	QMutexLocker locker(&mutex);
+	delete packs.value(snapType);
+	packs[snapType] = pack;
+
+	return true;
+}
+
+// scale the own image of every game to each thumbnail size and pack the raw pixels
+bool ThumbnailStore::build(int snapType, const QString &stamp)
+{
+	QHash<QString, QVector<ThumbnailRange> > index;
+
+	QDir().mkpath(CFG_PREFIX + "cache");
+	QSaveFile file(packPath(snapType));
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	QDataStream out(&file);
+	out << (quint32)MAMEPLUS_SIG;
+	out << (qint16)THUMB_PACK_VER;
+	out.setVersion(QDataStream::Qt_4_6);
+	out << stamp;
+	out << thumbSizes;
+
+	//patched after the images are written
+	qint64 indexOffsetPos = file.pos();
+	out << (qint64)0;
+
+	foreach (QString gameName, gameNames)
+	{
+		if (abort)
+			return false;
+
+		QImage image;
+		if (!image.loadFromData(UpdateSelectionThread::readSnap(sourcePaths[snapType], gameName, snapType, snapName)))
+			continue;
+
+		//stored as is, alpha only where there is some
+		QImage::Format format = image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+
+		QVector<ThumbnailRange> ranges;
+		int prevSize = 0;
+		foreach (int thumbSize, thumbSizes)
+		{
+			//an image that fits a smaller size is the same for the larger ones
+			if (!ranges.isEmpty() && image.width() <= prevSize && image.height() <= prevSize)
+			{
+				ranges << ranges.last();
+				continue;
+			}
+			prevSize = thumbSize;
+
+			QImage thumb = image;
+			if (image.width() > thumbSize || image.height() > thumbSize)
+				thumb = image.scaled(thumbSize, thumbSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+			thumb = thumb.convertToFormat(format);
+
+			QByteArray record;
+			QDataStream rec(&record, QIODevice::WriteOnly);
+			rec.setVersion(QDataStream::Qt_4_6);
+			rec << (qint32)thumb.width();
+			rec << (qint32)thumb.height();
+			rec << (qint32)thumb.format();
+			rec << qCompress(thumb.constBits(), thumb.byteCount(), 1);
+
+			ranges << ThumbnailRange(file.pos(), record.size());
+			file.write(record);
+		}
+
+		index[gameName] = ranges;
+	}
+
+	qint64 indexOffset = file.pos();
+	out << index;
+	file.seek(indexOffsetPos);
+	out << indexOffset;
+
+	return file.commit();
+}
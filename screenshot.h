@@ -2,6 +2,10 @@
 #define _SCREENSHOT_H_
 
 #include <QtWidgets>
+
+//smallest mip level, in pixels
+#define MIP_MIN_SIZE 128
+
 class Screenshot : public QDockWidget
 {
     Q_OBJECT
@@ -10,7 +14,12 @@ public:
     Screenshot(QString, QWidget *parent = 0);
 	void setPixmap(QPixmap pm);
 	void setPixmap(const QByteArray &, bool);
+	void setImage(const QVector<QImage> &, const QImage &, bool);
     void updateScreenshotLabel(bool = false);
+	QSize boundingSize() const;
+
+	static QVector<QImage> buildMipChain(const QImage &);
+	static QImage scaleMipChain(const QVector<QImage> &, const QSize &);
 
 protected:
     void resizeEvent(QResizeEvent *);
@@ -20,10 +29,55 @@ private slots:
 
 private:
 	QPushButton *screenshotLabel;
-	QPixmap originalPixmap;
+	QVector<QImage> mipLevels;	//original first, then halved down to MIP_MIN_SIZE
+	QImage fittedImage;			//scaled to the label by the loader
 	QGridLayout *mainLayout;
 	QWidget *dockWidgetContents;
 	bool forceAspect;
 };
 
+#define THUMB_PACK_VER 2
+
+typedef QPair<qint64 /*offset*/, qint64 /*length*/> ThumbnailRange;
+
+// pre-scaled snaps of one snap type, the pack file is mapped
+class ThumbnailPack
+{
+public:
+	QString stamp;
+	QFile file;
+	uchar *map;
+	QHash<QString /*gameName*/, QVector<ThumbnailRange> /*one per thumbnail size*/> index;
+};
+
+// builds thumbnail packs in the background and serves them, one pack per snap type
+class ThumbnailStore : public QThread
+{
+public:
+	ThumbnailStore(QObject *parent = 0);
+	~ThumbnailStore();
+
+	void update(const QStringList &);
+	int sizeFor(const QSize &) const;
+	bool find(int, const QString &, int, QImage &);
+
+protected:
+	void run();
+
+private:
+	QMutex mutex;
+	bool abort;
+	QList<int> thumbSizes;	//longest sides, ascending
+	QHash<int /*snapType*/, ThumbnailPack *> packs;
+	QHash<int /*snapType*/, QString /*stamp*/> staleStamps;
+	QHash<int /*snapType*/, QString> sourcePaths;
+	QString snapName;
+	QStringList gameNames;
+
+	QString packPath(int) const;
+	QString sourceStamp(int) const;
+	bool open(int, const QString &);
+	bool build(int, const QString &);
+};
+
 #endif
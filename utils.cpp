@@ -1,3 +1,4 @@
+#include <QSaveFile>
 #include "quazip.h"
 #include "quazipfile.h"
 #include "7zCrc.h"
@@ -20,6 +21,10 @@ Utils::Utils(QObject *parent) :
 	rxSpace("\\s+")
 {
 	initDescMap();
+
+	//in MB
+	szMemberCache.setSize(pGuiSettings->value("sevenzip_cache_size", 64).toInt() * 1024);
+	imageCache.setSize(pGuiSettings->value("image_cache_size", 64).toInt() * 1024);
 }
 
 QSize Utils::getScaledSize(QSize orig, QSize bounding, bool forceAspect)
@@ -209,6 +214,12 @@ QString Utils::getMameVersion()
 	return mameVersion;
 }
 
+// hit rates of the shared caches, shown in the status bar
+QString Utils::getCacheStats()
+{
+	return imageCache.stats() + "\n" + szMemberCache.stats();
+}
+
 void Utils::getMameVersionReadyReadStandardOutput()
 {
 	QProcess *proc = (QProcess *)sender();
@@ -308,6 +319,23 @@ bool Utils::matchMameFile(const QString &fileName, const QStringList &fileNameFi
 	return false;
 }
 
+void Utils::insertMameFile(QHash<QString, MameFileInfo *> &mameFileInfoList, const QString &fileName, quint32 crc, const QByteArray &data, int method, const QString &extractPath, const GameInfo *itemInfo)
+{
+	MameFileInfo *mameFileInfo = new MameFileInfo();
+	mameFileInfo->size = data.size();
+	if (method > MAMEFILE_GETDATINFO)
+		mameFileInfo->data = data;
+	mameFileInfo->crc = crc;
+	mameFileInfoList.insert(fileName, mameFileInfo);
+
+	if (method == MAMEFILE_EXTRACT)
+	{
+	//	bool re = 
+		extractMameFile(fileName, mameFileInfo, extractPath, itemInfo);
+	//	win->log(QString("7zext: %1: %2: %3").arg(fileName).arg(extractPath).arg(re));
+	}
+}
+
 bool Utils::extractMameFile(const QString &zipFileName, MameFileInfo *mameFileInfo, const QString &outPath, const GameInfo *itemInfo)
 {
 	bool result = false;
@@ -363,6 +391,713 @@ bool Utils::extractMameFile(const QString &zipFileName, MameFileInfo *mameFileIn
 	return result;
 }
 
+ArchiveIndex::ArchiveIndex() :
+	isLoaded(false),
+	isDirty(false)
+{
+}
+
+int ArchiveIndex::find(const QString &path, const QString &name, ArchiveEntry &entry)
+{
+	QList<ArchiveEntry> entries;
+	int result = find(path, QStringList(name), entries);
+	if (result == ARCHIVE_FOUND)
+		entry = entries.first();
+
+	return result;
+}
+
+// look up entries by name or file name in archive order, the archive is (re)read if it changed on disk
+int ArchiveIndex::find(const QString &path, const QStringList &names, QList<ArchiveEntry> &entries)
+{
+	QFileInfo fileInfo(path);
+	if (!fileInfo.exists())
+		return ARCHIVE_ABSENT;
+
+	qint64 size = fileInfo.size();
+	qint64 mtime = fileInfo.lastModified().toMSecsSinceEpoch();
+
+	mutex.lock();
+	if (!isLoaded)
+		load();
+	bool isCurrent = archives.contains(path) && 
+		archives[path].size == size && archives[path].mtime == mtime;
+	mutex.unlock();
+
+	//read outside the lock, other archives can still be looked up
+	if (!isCurrent)
+	{
+		ArchiveDirectory archive;
+		archive.size = size;
+		archive.mtime = mtime;
+
+		bool result;
+		if (path.endsWith(SZIP_EXT, Qt::CaseInsensitive))
+			result = read7z(path, archive);
+		else
+			result = readZip(path, archive);
+
+		if (!result)
+			return ARCHIVE_UNINDEXED;
+
+		QMutexLocker locker(&mutex);
+		archives[path] = archive;
+		isDirty = true;
+	}
+
+	QMutexLocker locker(&mutex);
+	const ArchiveDirectory &archive = archives[path];
+
+	QMap<quint32, ArchiveEntry> found;
+	foreach (QString name, names)
+	{
+		QString key = name.toLower();
+		QHash<QString, ArchiveEntry>::const_iterator it = archive.entries.constFind(key);
+		if (it == archive.entries.constEnd())
+			it = archive.entries.constFind(archive.fileNames.value(key));
+		if (it != archive.entries.constEnd())
+			found.insert(it.value().fileIndex, it.value());
+	}
+
+	if (found.isEmpty())
+		return ARCHIVE_ABSENT;
+
+	entries = found.values();
+	return ARCHIVE_FOUND;
+}
+
+bool ArchiveIndex::readZip(const QString &path, ArchiveDirectory &archive)
+{
+	QuaZip zip(path);
+	if(!zip.open(QuaZip::mdUnzip))
+		return false;
+
+	QuaZipFileInfo zipFileInfo;
+	for (bool more = zip.goToFirstFile(); more; more = zip.goToNextFile())
+	{
+		if(!zip.getCurrentFileInfo(&zipFileInfo))
+			continue;
+
+		//no directories
+		if (zipFileInfo.name.endsWith("/"))
+			continue;
+
+		unz_file_pos filePos;
+		if (unzGetFilePos(zip.getUnzFile(), &filePos) != UNZ_OK)
+			continue;
+
+		ArchiveEntry entry;
+		entry.name = zipFileInfo.name;
+		entry.offset = filePos.pos_in_zip_directory;
+		entry.fileIndex = filePos.num_of_file;
+		entry.crc = zipFileInfo.crc;
+		entry.size = zipFileInfo.uncompressedSize;
+		entry.method = zipFileInfo.method;
+
+		QString key = entry.name.toLower();
+		QString fileName = QFileInfo(key).fileName();
+		//first match wins, same as iterating
+		if (archive.entries.contains(key))
+			continue;
+		archive.entries.insert(key, entry);
+		if (!archive.fileNames.contains(fileName))
+			archive.fileNames.insert(fileName, key);
+	}
+	zip.close();
+
+	return true;
+}
+
+bool ArchiveIndex::read7z(const QString &path, ArchiveDirectory &archive)
+{
+	CFileInStream archiveStream;
+	CLookToRead lookStream;
+	CSzArEx db;
+	SRes res;
+	ISzAlloc allocImp;
+	ISzAlloc allocTempImp;
+
+	if (InFile_Open(&archiveStream.file, qPrintable(path)))
+		return false;
+
+	FileInStream_CreateVTable(&archiveStream);
+	LookToRead_CreateVTable(&lookStream, False);
+
+	lookStream.realStream = &archiveStream.s;
+	LookToRead_Init(&lookStream);
+
+	allocImp.Alloc = SzAlloc;
+	allocImp.Free = SzFree;
+
+	allocTempImp.Alloc = SzAllocTemp;
+	allocTempImp.Free = SzFreeTemp;
+
+	CrcGenerateTable();
+
+	SzArEx_Init(&db);
+	res = SzArEx_Open(&db, &lookStream.s, &allocImp, &allocTempImp);
+
+	if (res == SZ_OK)
+	{
+		for (UInt32 i = 0; i < db.db.NumFiles; i++)
+		{
+			CSzFileItem *f = db.db.Files + i;
+
+			//no directories
+			if (f->IsDir)
+				continue;
+
+			ArchiveEntry entry;
+			entry.name = f->Name;
+			entry.offset = 0;
+			entry.fileIndex = i;
+			entry.crc = f->FileCRC;
+			entry.size = f->Size;
+			entry.method = 0;
+
+			QString key = entry.name.toLower();
+			QString fileName = QFileInfo(key).fileName();
+			if (archive.entries.contains(key))
+				continue;
+			archive.entries.insert(key, entry);
+			if (!archive.fileNames.contains(fileName))
+				archive.fileNames.insert(fileName, key);
+		}
+	}
+
+	SzArEx_Free(&db, &allocImp);
+	File_Close(&archiveStream.file);
+
+	return res == SZ_OK;
+}
+
+// must be called with the mutex locked
+void ArchiveIndex::load()
+{
+	QFile file(CFG_PREFIX + "cache/archive.index");
+	isLoaded = true;
+
+	if (!file.open(QIODevice::ReadOnly))
+		return;
+
+	QDataStream in(&file);
+	in.setVersion(QDataStream::Qt_4_6);
+
+	quint32 mamepSig;
+	qint16 indexVersion;
+	in >> mamepSig;
+	in >> indexVersion;
+	if (mamepSig != MAMEPLUS_SIG || indexVersion != ARCHIVE_INDEX_VER)
+		return;
+
+	int count;
+	in >> count;
+	for (int i = 0; i < count && in.status() == QDataStream::Ok; i++)
+	{
+		QString path;
+		ArchiveDirectory archive;
+		int numEntries;
+
+		in >> path;
+		in >> archive.size;
+		in >> archive.mtime;
+		in >> numEntries;
+
+		for (int j = 0; j < numEntries && in.status() == QDataStream::Ok; j++)
+		{
+			ArchiveEntry entry;
+			in >> entry.name;
+			in >> entry.offset;
+			in >> entry.fileIndex;
+			in >> entry.crc;
+			in >> entry.size;
+			in >> entry.method;
+
+			QString key = entry.name.toLower();
+			QString fileName = QFileInfo(key).fileName();
+			archive.entries.insert(key, entry);
+			if (!archive.fileNames.contains(fileName))
+				archive.fileNames.insert(fileName, key);
+		}
+
+		archives[path] = archive;
+	}
+
+	if (in.status() != QDataStream::Ok)
+		archives.clear();
+}
+
+void ArchiveIndex::save()
+{
+	QMutexLocker locker(&mutex);
+	if (!isDirty)
+		return;
+
+	QDir().mkpath(CFG_PREFIX + "cache");
+	QSaveFile file(CFG_PREFIX + "cache/archive.index");
+	if (!file.open(QIODevice::WriteOnly))
+		return;
+
+	//archives that are gone drop out
+	QStringList paths;
+	foreach (QString path, archives.keys())
+		if (QFile::exists(path))
+			paths << path;
+
+	QDataStream out(&file);
+	out << (quint32)MAMEPLUS_SIG;
+	out << (qint16)ARCHIVE_INDEX_VER;
+	out.setVersion(QDataStream::Qt_4_6);
+	out << paths.size();
+
+	foreach (QString path, paths)
+	{
+		const ArchiveDirectory &archive = archives[path];
+		out << path;
+		out << archive.size;
+		out << archive.mtime;
+		out << archive.entries.size();
+
+		//keep the archive order so the first match by file name is stable
+		QMap<quint32, ArchiveEntry> entries;
+		foreach (const ArchiveEntry &entry, archive.entries)
+			entries.insert(entry.fileIndex, entry);
+
+		foreach (const ArchiveEntry &entry, entries)
+		{
+			out << entry.name;
+			out << entry.offset;
+			out << entry.fileIndex;
+			out << entry.crc;
+			out << entry.size;
+			out << entry.method;
+		}
+	}
+
+	if (file.commit())
+		isDirty = false;
+}
+
+SzBlock::SzBlock(void *_buffer, size_t _bufferSize) :
+	buffer(_buffer),
+	bufferSize(_bufferSize)
+{
+}
+
+SzBlock::~SzBlock()
+{
+	SzFree(NULL, buffer);
+}
+
+SzMemberCache::SzMemberCache() :
+	numHits(0),
+	numMisses(0),
+	numBlockHits(0),
+	numBlockMisses(0)
+{
+}
+
+// members and folders get the same budget each
+void SzMemberCache::setSize(int size)
+{
+	QMutexLocker locker(&mutex);
+	cache.setMaxCost(qMax(size, 0));
+	blocks.setMaxCost(qMax(size, 0));
+}
+
+int SzMemberCache::size() const
+{
+	QMutexLocker locker(&mutex);
+	return cache.maxCost();
+}
+
+bool SzMemberCache::find(const QString &key, QByteArray &data)
+{
+	QMutexLocker locker(&mutex);
+	QByteArray *member = cache.object(key);
+	if (member == NULL)
+	{
+		numMisses++;
+		return false;
+	}
+
+	numHits++;
+	data = *member;
+	return true;
+}
+
+void SzMemberCache::insert(const QString &key, const QByteArray &data)
+{
+	QMutexLocker locker(&mutex);
+	cache.insert(key, new QByteArray(data), qMax(data.size() / 1024, 1));
+}
+
+// the folder is handed over to the caller, no other thread decodes into it meanwhile
+bool SzMemberCache::takeBlock(const QString &key, void *&buffer, size_t &bufferSize)
+{
+	QMutexLocker locker(&mutex);
+	SzBlock *block = blocks.take(key);
+	if (block == NULL)
+	{
+		numBlockMisses++;
+		return false;
+	}
+
+	numBlockHits++;
+	buffer = block->buffer;
+	bufferSize = block->bufferSize;
+	block->buffer = NULL;
+	delete block;
+	return true;
+}
+
+// the cache owns the buffer from now on, a folder over the budget is freed
+void SzMemberCache::insertBlock(const QString &key, void *buffer, size_t bufferSize)
+{
+	QMutexLocker locker(&mutex);
+	if (bufferSize / 1024 >= (size_t)blocks.maxCost())
+	{
+		SzFree(NULL, buffer);
+		return;
+	}
+
+	blocks.insert(key, new SzBlock(buffer, bufferSize), (int)(bufferSize / 1024) + 1);
+}
+
+QString SzMemberCache::stats() const
+{
+	QMutexLocker locker(&mutex);
+	return QString("7z members: %1 hits, %2 misses, %3k used\n7z folders: %4 hits, %5 misses, %6k used")
+		.arg(numHits).arg(numMisses).arg(cache.totalCost())
+		.arg(numBlockHits).arg(numBlockMisses).arg(blocks.totalCost());
+}
+
+ImageCache::ImageCache() :
+	numHits(0),
+	numMisses(0),
+	numOversized(0)
+{
+}
+
+void ImageCache::setSize(int size)
+{
+	QMutexLocker locker(&mutex);
+	cache.setMaxCost(qMax(size, 0));
+}
+
+bool ImageCache::find(const QString &key, QVector<QImage> &levels)
+{
+	QMutexLocker locker(&mutex);
+	QVector<QImage> *cachedLevels = cache.object(key);
+	if (cachedLevels == NULL)
+		numMisses++;
+	else
+	{
+		numHits++;
+		levels = *cachedLevels;
+	}
+
+	return cachedLevels != NULL;
+}
+
+void ImageCache::insert(const QString &key, const QVector<QImage> &levels)
+{
+	int cost = 0;
+	foreach (const QImage &image, levels)
+		cost += image.byteCount() / 1024;
+
+	cost = qMax(cost, 1);
+
+	//a mip chain over the budget would be dropped by QCache right away, count it instead
+	QMutexLocker locker(&mutex);
+	if (cost > cache.maxCost())
+	{
+		numOversized++;
+		return;
+	}
+
+	cache.insert(key, new QVector<QImage>(levels), cost);
+}
+
+void ImageCache::clear()
+{
+	QMutexLocker locker(&mutex);
+	cache.clear();
+}
+
+QString ImageCache::stats() const
+{
+	QMutexLocker locker(&mutex);
+	int lookups = numHits + numMisses;
+	return QString("artwork: %1 hits, %2 misses (%3%), %4k used, %5 too large")
+		.arg(numHits).arg(numMisses).arg(lookups > 0 ? numHits * 100 / lookups : 0)
+		.arg(cache.totalCost()).arg(numOversized);
+}
+
+DatFile::DatFile() :
+	size(0),
+	mtime(0),
+	file(NULL),
+	map(NULL),
+	length(0)
+{
+}
+
+DatFile::~DatFile()
+{
+	//unmaps as well
+	delete file;
+}
+
+DatIndex::DatIndex() :
+	isLoaded(false),
+	isDirty(false)
+{
+}
+
+// copy the entry of a tag, returns false if the dat can not be read or has no such entry
+bool DatIndex::find(const QString &fileName, const QString &tag, QByteArray &entry)
+{
+	QFileInfo fileInfo(fileName);
+	QString path = fileInfo.absoluteFilePath();
+	qint64 size, mtime;
+	bool isPlainFile = fileInfo.exists();
+
+	if (isPlainFile)
+	{
+		size = fileInfo.size();
+		mtime = fileInfo.lastModified().toMSecsSinceEpoch();
+	}
+	else
+	{
+		//dats packed in <dat name>.zip or .7z next to it
+		QString archPath = fileInfo.absolutePath() + "/" + fileInfo.baseName();
+		QFileInfo zipInfo(archPath + ZIP_EXT);
+		QFileInfo szipInfo(archPath + SZIP_EXT);
+		if (!zipInfo.exists() && !szipInfo.exists())
+			return false;
+
+		size = zipInfo.size() + szipInfo.size();
+		mtime = qMax(zipInfo.exists() ? zipInfo.lastModified().toMSecsSinceEpoch() : 0, 
+			szipInfo.exists() ? szipInfo.lastModified().toMSecsSinceEpoch() : 0);
+	}
+
+	mutex.lock();
+	bool needsLoad = !isLoaded;
+	mutex.unlock();
+
+	//read the saved index outside the lock, the first caller to finish wins
+	if (needsLoad)
+	{
+		QHash<QString, QSharedPointer<DatFile> > loaded;
+		load(loaded);
+
+		mutex.lock();
+		if (!isLoaded)
+		{
+			dats = loaded;
+			isLoaded = true;
+		}
+		mutex.unlock();
+	}
+
+	mutex.lock();
+	QSharedPointer<DatFile> dat = dats.value(path);
+	mutex.unlock();
+
+	bool isCurrent = !dat.isNull() && dat->size == size && dat->mtime == mtime;
+
+	//read and scan the dat outside the lock, entries in the index are never modified
+	if (!isCurrent || (dat->map == NULL && dat->data.isEmpty()))
+	{
+		QSharedPointer<DatFile> opened(open(path, isPlainFile, isCurrent ? dat.data() : NULL));
+
+		//keep the indexed entry, a dat that can not be read is not stored
+		if (opened.isNull())
+			return false;
+
+		opened->size = size;
+		opened->mtime = mtime;
+
+		mutex.lock();
+		dats[path] = opened;
+		if (!isCurrent || dat->ranges.isEmpty())
+			isDirty = true;
+		mutex.unlock();
+
+		dat = opened;
+	}
+
+	if (!dat->ranges.contains(tag))
+		return false;
+
+	//ranges of the saved index are trusted only within the contents
+	const DatRange range = dat->ranges[tag];
+	if (range.first < 0 || range.second < 0 || range.first + range.second > dat->length)
+		return false;
+
+	const char *data = dat->map != NULL ? (const char *)dat->map : dat->data.constData();
+	entry = QByteArray(data + range.first, range.second);
+
+	return true;
+}
+
+// read a dat, ranges are reused from the indexed one if it is still current, NULL if it can not be read
+DatFile *DatIndex::open(const QString &path, bool isPlainFile, const DatFile *indexed)
+{
+	DatFile *dat = new DatFile();
+
+	if (isPlainFile)
+	{
+		dat->file = new QFile(path);
+		if (dat->file->open(QIODevice::ReadOnly))
+			dat->map = dat->file->map(0, dat->file->size());
+
+		if (dat->map == NULL)
+		{
+			dat->data = dat->file->readAll();
+			dat->file->close();
+		}
+	}
+	else
+	{
+		QStringList paths = utils->split2Str(path, "/", true);
+		QHash<QString, MameFileInfo *> mameFileInfoList =
+			utils->iterateMameFile(paths.first(), "", paths.last(), MAMEFILE_READ);
+
+		if (mameFileInfoList.size() > 0)
+			dat->data = mameFileInfoList[mameFileInfoList.keys().first()]->data;
+
+		utils->clearMameFileInfoList(mameFileInfoList);
+	}
+
+	if (dat->map == NULL && dat->data.isEmpty())
+	{
+		delete dat;
+		return NULL;
+	}
+
+	const char *data = dat->map != NULL ? (const char *)dat->map : dat->data.constData();
+	dat->length = dat->map != NULL ? dat->file->size() : dat->data.size();
+
+	//the index only holds for the same contents
+	if (indexed != NULL && !indexed->ranges.isEmpty())
+		dat->ranges = indexed->ranges;
+	else
+		scan(data, dat->length, dat->ranges);
+
+	return dat;
+}
+
+// map every $info= tag to the entry that follows, up to the next $info= without the tag
+void DatIndex::scan(const char *data, qint64 size, QHash<QString, DatRange> &ranges)
+{
+	QHash<QString, qint64> openTags;
+	qint64 pos = 0;
+
+	while (pos < size)
+	{
+		const char *eol = (const char *)memchr(data + pos, '\n', size - pos);
+		qint64 next = eol != NULL ? eol - data + 1 : size;
+
+		if (next - pos > 6 && memcmp(data + pos, "$info=", 6) == 0)
+		{
+			QByteArray line(data + pos + 6, next - pos - 6);
+			while (line.endsWith('\n') || line.endsWith('\r'))
+				line.chop(1);
+
+			QStringList tags = QString::fromUtf8(line).split(',');
+
+			//reach another entry, stop recording
+			foreach (QString tag, openTags.keys())
+			{
+				if (tags.contains(tag))
+					continue;
+
+				ranges[tag] = DatRange(openTags[tag], pos - openTags[tag]);
+				openTags.remove(tag);
+			}
+
+			//only the first entry of a tag is used
+			foreach (QString tag, tags)
+				if (!ranges.contains(tag) && !openTags.contains(tag))
+					openTags[tag] = next;
+		}
+
+		pos = next;
+	}
+
+	foreach (QString tag, openTags.keys())
+		ranges[tag] = DatRange(openTags[tag], size - openTags[tag]);
+}
+
+// read the saved index
+void DatIndex::load(QHash<QString, QSharedPointer<DatFile> > &loaded)
+{
+	QFile file(CFG_PREFIX + "cache/dat.index");
+
+	if (!file.open(QIODevice::ReadOnly))
+		return;
+
+	QDataStream in(&file);
+	in.setVersion(QDataStream::Qt_4_6);
+
+	quint32 mamepSig;
+	qint16 indexVersion;
+	in >> mamepSig;
+	in >> indexVersion;
+	if (mamepSig != MAMEPLUS_SIG || indexVersion != DAT_INDEX_VER)
+		return;
+
+	int count;
+	in >> count;
+	for (int i = 0; i < count && in.status() == QDataStream::Ok; i++)
+	{
+		QString path;
+		QSharedPointer<DatFile> dat(new DatFile());
+
+		in >> path;
+		in >> dat->size;
+		in >> dat->mtime;
+		in >> dat->ranges;
+
+		loaded[path] = dat;
+	}
+
+	if (in.status() != QDataStream::Ok)
+		loaded.clear();
+}
+
+void DatIndex::save()
+{
+	QMutexLocker locker(&mutex);
+	if (!isDirty)
+		return;
+
+	QDir().mkpath(CFG_PREFIX + "cache");
+	QSaveFile file(CFG_PREFIX + "cache/dat.index");
+	if (!file.open(QIODevice::WriteOnly))
+		return;
+
+	QDataStream out(&file);
+	out << (quint32)MAMEPLUS_SIG;
+	out << (qint16)DAT_INDEX_VER;
+	out.setVersion(QDataStream::Qt_4_6);
+	out << dats.size();
+
+	foreach (QString path, dats.keys())
+	{
+		const QSharedPointer<DatFile> dat = dats[path];
+		out << path;
+		out << dat->size;
+		out << dat->mtime;
+		out << dat->ranges;
+	}
+
+	if (file.commit())
+		isDirty = false;
+}
+
 //fixme: filter dir from zip and path, handle paths in the zip/7z, cases
 QHash<QString, MameFileInfo *> Utils::iterateMameFile(const QString &_dirPaths, const QString &_archNames, const QString &_fileNameFilters, int method, const QString &_extractPath, const MameDat *_pFixDat)
 {
@@ -370,6 +1105,7 @@ QHash<QString, MameFileInfo *> Utils::iterateMameFile(const QString &_dirPaths,
 	QHash<QString, MameFileInfo *> mameFileInfoList;
 	MameFileInfo *mameFileInfo;
 	bool isSingleFile = true;
+	bool isExactName = true;
 	QStringList dirPaths = _dirPaths.split(";");
 	QStringList archNames = _archNames.split(";");
 	QStringList fileNameFilters = _fileNameFilters.split(";");
@@ -380,6 +1116,11 @@ QHash<QString, MameFileInfo *> Utils::iterateMameFile(const QString &_dirPaths,
 		fileNameFilters.first().startsWith("?"))
 		isSingleFile = false;
 
+	//exact file names can be looked up in the archive index
+	foreach (QString fileNameFilter, fileNameFilters)
+		if (fileNameFilter.startsWith("*") || fileNameFilter.startsWith("?"))
+			isExactName = false;
+
 	//fixme: only process first path for now
 	QString extractPath = extractPaths.first();
 	if (extractPath.isEmpty())
@@ -471,6 +1212,12 @@ QHash<QString, MameFileInfo *> Utils::iterateMameFile(const QString &_dirPaths,
 		if (isSingleFile && mameFileInfoList.size() > 0)
 			break;
 
+		//exact file names are looked up in the archive index instead of walking the archive
+		QList<ArchiveEntry> entries;
+		int lookup = ARCHIVE_UNINDEXED;
+		if (isExactName)
+			lookup = archiveIndex.find(_dirPath + archName + ZIP_EXT, fileNameFilters, entries);
+
 		// iterate all fileNames in the .zip
 		QuaZip zip(_dirPath + archName + ZIP_EXT);
 
@@ -480,9 +1227,20 @@ QHash<QString, MameFileInfo *> Utils::iterateMameFile(const QString &_dirPaths,
 			itemInfo = pFixDat->games[archName];
 		
 //		win->log("testing: " + _dirPath + archName + ZIP_EXT);
-		if(zip.open(QuaZip::mdUnzip))
+		if(lookup != ARCHIVE_ABSENT && zip.open(QuaZip::mdUnzip))
 		{
-			for (bool more = zip.goToFirstFile(); more; more = zip.goToNextFile())
+			bool more = zip.goToFirstFile();
+
+			//jump to the first indexed entry
+			if (more && lookup == ARCHIVE_FOUND)
+			{
+				unz_file_pos filePos;
+				filePos.pos_in_zip_directory = entries.first().offset;
+				filePos.num_of_file = entries.first().fileIndex;
+				more = unzGoToFilePos(zip.getUnzFile(), &filePos) == UNZ_OK;
+			}
+
+			for (; more; more = zip.goToNextFile())
 			{
 				if (isSingleFile && mameFileInfoList.size() > 0)
 					break;
@@ -527,6 +1285,39 @@ QHash<QString, MameFileInfo *> Utils::iterateMameFile(const QString &_dirPaths,
 		if (isSingleFile && mameFileInfoList.size() > 0)
 			break;
 
+		QString szPath = _dirPath + archName + SZIP_EXT;
+
+		entries.clear();
+		lookup = ARCHIVE_UNINDEXED;
+		if (isExactName)
+			lookup = archiveIndex.find(szPath, fileNameFilters, entries);
+
+		if (lookup == ARCHIVE_ABSENT)
+			continue;
+
+		qint64 szMtime = QFileInfo(szPath).lastModified().toMSecsSinceEpoch();
+
+		//indexed members decoded by an earlier call are served without opening the archive
+		QList<ArchiveEntry> pending;
+		foreach (const ArchiveEntry &szEntry, entries)
+		{
+			if (isSingleFile && mameFileInfoList.size() > 0)
+				break;
+
+			//already loaded
+			if (mameFileInfoList.contains(szEntry.name))
+				continue;
+
+			QByteArray member;
+			if (szMemberCache.find(QString("%1|%2|%3").arg(szPath).arg(szMtime).arg(szEntry.fileIndex), member))
+				insertMameFile(mameFileInfoList, szEntry.name, szEntry.crc, member, method, extractPath, itemInfo);
+			else
+				pending << szEntry;
+		}
+
+		if (lookup == ARCHIVE_FOUND && pending.isEmpty())
+			continue;
+
 		// iterate all fileNames in the .7z
 		// implementation from LZMA SDK's 7zMain.c
 		CFileInStream archiveStream;
@@ -536,7 +1327,7 @@ QHash<QString, MameFileInfo *> Utils::iterateMameFile(const QString &_dirPaths,
 		ISzAlloc allocImp;
 		ISzAlloc allocTempImp;
 
-		if (InFile_Open(&archiveStream.file,  qPrintable(_dirPath + archName + SZIP_EXT)))
+		if (InFile_Open(&archiveStream.file,  qPrintable(szPath)))
 			continue;
 
 		FileInStream_CreateVTable(&archiveStream);
@@ -558,8 +1349,6 @@ QHash<QString, MameFileInfo *> Utils::iterateMameFile(const QString &_dirPaths,
 
 		if (res == SZ_OK)
 		{
-			UInt32 i;
-
 			/*
 			if you need cache, use these 3 variables.
 			if you use external function, you can make these variable as static.
@@ -568,11 +1357,17 @@ QHash<QString, MameFileInfo *> Utils::iterateMameFile(const QString &_dirPaths,
 			Byte *outBuffer = 0; /* it must be 0 before first call for each new archive. */
 			size_t outBufferSize = 0;  /* it can have any value before first call (if outBuffer = 0) */
 
-			for (i = 0; i < db.db.NumFiles; i++)
+			//decode only the indexed members that are left, or walk an unindexed archive
+			int numFiles = lookup == ARCHIVE_FOUND ? pending.size() : (int)db.db.NumFiles;
+			for (int n = 0; n < numFiles; n++)
 			{
 				if (isSingleFile && mameFileInfoList.size() > 0)
 					break;
 
+				UInt32 i = lookup == ARCHIVE_FOUND ? pending[n].fileIndex : (UInt32)n;
+				if (i >= db.db.NumFiles)
+					continue;
+
 				size_t offset;
 				size_t outSizeProcessed;
 				CSzFileItem *f = db.db.Files + i;
@@ -588,32 +1383,67 @@ QHash<QString, MameFileInfo *> Utils::iterateMameFile(const QString &_dirPaths,
 				if (!matchMameFile(f->Name, fileNameFilters, f->FileCRC))
 					continue;
 
-				res = SzAr_Extract(&db, &lookStream.s, i,
-					&blockIndex, &outBuffer, &outBufferSize,
-					&offset, &outSizeProcessed,
-					&allocImp, &allocTempImp);
-
-				if (res != SZ_OK)
+				//reuse a member decoded by an earlier call, indexed ones were looked up already
+				QString memberKey = QString("%1|%2|%3").arg(szPath).arg(szMtime).arg(i);
+				QByteArray member;
+				if (lookup == ARCHIVE_FOUND || !szMemberCache.find(memberKey, member))
 				{
-					win->log(QString("SZ_RES: %1.").arg(res));
-					break;
+					//continue in a folder decoded by an earlier lookup, the current one is kept for later
+					UInt32 folderIndex = db.FileIndexToFolderIndexMap[i];
+					void *block;
+					size_t blockSize;
+					if (folderIndex != (UInt32)-1 && (outBuffer == 0 || folderIndex != blockIndex) &&
+						szMemberCache.takeBlock(QString("%1|%2|%3").arg(szPath).arg(szMtime).arg(folderIndex), block, blockSize))
+					{
+						if (outBuffer != 0)
+							szMemberCache.insertBlock(QString("%1|%2|%3").arg(szPath).arg(szMtime).arg(blockIndex), outBuffer, outBufferSize);
+						blockIndex = folderIndex;
+						outBuffer = (Byte *)block;
+						outBufferSize = blockSize;
+					}
+
+					res = SzAr_Extract(&db, &lookStream.s, i,
+						&blockIndex, &outBuffer, &outBufferSize,
+						&offset, &outSizeProcessed,
+						&allocImp, &allocTempImp);
+
+					if (res != SZ_OK)
+					{
+						win->log(QString("SZ_RES: %1.").arg(res));
+						break;
+					}
+
+					member = QByteArray((const char *)outBuffer + offset, outSizeProcessed);
+					szMemberCache.insert(memberKey, member);
+
+					//the next members of a solid block are usually asked for next,
+					//keep some of them while the block is decoded
+					size_t nextOffset = offset + outSizeProcessed;
+					int budget = szMemberCache.size() / 4;
+					for (UInt32 j = i + 1; j < db.db.NumFiles && budget > 0; j++)
+					{
+						CSzFileItem *g = db.db.Files + j;
+						if (db.FileIndexToFolderIndexMap[j] != folderIndex ||
+							nextOffset + (size_t)g->Size > outBufferSize)
+							break;
+
+						if (!g->IsDir && g->Size > 0)
+						{
+							szMemberCache.insert(QString("%1|%2|%3").arg(szPath).arg(szMtime).arg(j),
+								QByteArray((const char *)outBuffer + nextOffset, (int)g->Size));
+							budget -= (int)(g->Size / 1024) + 1;
+						}
+						nextOffset += (size_t)g->Size;
+					}
 				}
 
-				mameFileInfo = new MameFileInfo();
-				mameFileInfo->size = outSizeProcessed;
-				if (method > MAMEFILE_GETDATINFO)
-					mameFileInfo->data = QByteArray((const char *)outBuffer + offset, outSizeProcessed);
-				mameFileInfo->crc = f->FileCRC;
-				mameFileInfoList.insert(f->Name, mameFileInfo);
-
-				if (method == MAMEFILE_EXTRACT)
-				{
-				//	bool re = 
-					extractMameFile(f->Name, mameFileInfo, extractPath, itemInfo);
-				//	win->log(QString("7zext: %1: %2: %3").arg(f->Name).arg(extractPath).arg(re));
-				}
+				insertMameFile(mameFileInfoList, f->Name, f->FileCRC, member, method, extractPath, itemInfo);
 			}
-			IAlloc_Free(&allocImp, outBuffer);
+			//keep the last decoded folder for the next lookup in this archive
+			if (res == SZ_OK && outBuffer != 0)
+				szMemberCache.insertBlock(QString("%1|%2|%3").arg(szPath).arg(szMtime).arg(blockIndex), outBuffer, outBufferSize);
+			else
+				IAlloc_Free(&allocImp, outBuffer);
 		}
 
 		SzArEx_Free(&db, &allocImp);
@@ -21,6 +21,148 @@ public:
 	bool removable;
 };
 
+#define ARCHIVE_INDEX_VER 1
+
+enum
+{
+	ARCHIVE_UNINDEXED = 0,	//archive can not be indexed, iterate it
+	ARCHIVE_ABSENT,			//archive or entry does not exist
+	ARCHIVE_FOUND
+};
+
+// an entry in the central directory of a zip or 7z
+class ArchiveEntry
+{
+public:
+	QString name;
+	quint64 offset;		//zip: offset in central directory
+	quint32 fileIndex;	//zip: # of file, 7z: file index
+	quint32 crc;
+	quint64 size;
+	quint16 method;
+};
+
+class ArchiveDirectory
+{
+public:
+	qint64 size;
+	qint64 mtime;
+	QHash<QString /*lowercase name*/, ArchiveEntry> entries;
+	QHash<QString /*lowercase file name*/, QString /*lowercase name*/> fileNames;
+};
+
+// directories of archives read once and kept by path, shared by all threads
+class ArchiveIndex
+{
+public:
+	ArchiveIndex();
+	int find(const QString &path, const QString &name, ArchiveEntry &entry);
+	int find(const QString &path, const QStringList &names, QList<ArchiveEntry> &entries);
+	void save();
+
+private:
+	QMutex mutex;
+	bool isLoaded;
+	bool isDirty;
+	QHash<QString /*path*/, ArchiveDirectory> archives;
+
+	void load();
+	bool readZip(const QString &, ArchiveDirectory &);
+	bool read7z(const QString &, ArchiveDirectory &);
+};
+
+// a decoded 7z folder, the buffer belongs to the lzma allocator
+class SzBlock
+{
+public:
+	void *buffer;
+	size_t bufferSize;
+
+	SzBlock(void *, size_t);
+	~SzBlock();
+};
+
+// decoded 7z members and folders shared by all threads, cost is in KB
+class SzMemberCache
+{
+public:
+	SzMemberCache();
+	void setSize(int);
+	int size() const;
+	bool find(const QString &, QByteArray &);
+	void insert(const QString &, const QByteArray &);
+	bool takeBlock(const QString &, void *&, size_t &);
+	void insertBlock(const QString &, void *, size_t);
+	QString stats() const;
+
+private:
+	mutable QMutex mutex;
+	QCache<QString /*path|mtime|file*/, QByteArray> cache;
+	QCache<QString /*path|mtime|folder*/, SzBlock> blocks;
+	int numHits;
+	int numMisses;
+	int numBlockHits;
+	int numBlockMisses;
+};
+
+#define DAT_INDEX_VER 1
+
+typedef QPair<qint64 /*offset*/, qint64 /*length*/> DatRange;
+
+// a history.dat like file and the byte range of each $info= entry
+class DatFile
+{
+public:
+	qint64 size;
+	qint64 mtime;
+	QHash<QString /*tag*/, DatRange> ranges;
+	QFile *file;			//mapped plain file
+	const uchar *map;
+	QByteArray data;		//contents of a dat read from an archive
+	qint64 length;			//of the mapped or read contents
+
+	DatFile();
+	~DatFile();
+};
+
+// dats scanned once into tag ranges, entries are served from a mapping
+class DatIndex
+{
+public:
+	DatIndex();
+	bool find(const QString &fileName, const QString &tag, QByteArray &entry);
+	void save();
+
+private:
+	QMutex mutex;
+	bool isLoaded;
+	bool isDirty;
+	QHash<QString /*path*/, QSharedPointer<DatFile> > dats;
+
+	static void load(QHash<QString, QSharedPointer<DatFile> > &);
+	static DatFile *open(const QString &, bool, const DatFile *);
+	static void scan(const char *, qint64, QHash<QString, DatRange> &);
+};
+
+// decoded artwork mip chains keyed by type|gameName, cost is in KB
+class ImageCache
+{
+public:
+	ImageCache();
+	void setSize(int);
+	bool find(const QString &, QVector<QImage> &);
+	void insert(const QString &, const QVector<QImage> &);
+	void clear();
+	QString stats() const;
+
+private:
+	mutable QMutex mutex;
+	QCache<QString, QVector<QImage> > cache;
+	int numHits;
+	int numMisses;
+	int numOversized;
+};
+
 class MameDat;
 class GameInfo;
 
@@ -33,6 +175,10 @@ public:
 
 	QProcess *loadProc;
 	QRegExp rxSpace;
+	ArchiveIndex archiveIndex;
+	SzMemberCache szMemberCache;
+	DatIndex datIndex;
+	ImageCache imageCache;
 
 	QString getDesc(const QString &, bool = true);
 	QSize getScaledSize(QSize, QSize, bool);
@@ -42,6 +188,7 @@ public:
 	QString getPath(QString);
 	QString getSinglePath(QString, QString);
 	QString getMameVersion();
+	QString getCacheStats();
 
 	quint8 getStatus(QString);
 	QString getStatusString(quint8, bool = false);
@@ -63,6 +210,7 @@ private:
 	QMap<QString, QString> descMap;
 	void initDescMap();
 	bool matchMameFile(const QString &, const QStringList &, quint32);
+	void insertMameFile(QHash<QString, MameFileInfo *> &, const QString &, quint32, const QByteArray &, int, const QString &, const GameInfo *);
 	bool extractMameFile(const QString &, MameFileInfo *, const QString &outPath, const GameInfo *itemInfo = NULL);
 };
 